@@ -0,0 +1,75 @@
+// Measures how many log lines per second the platform logging backend
+// sustains with 1 to 16 threads logging concurrently.
+//
+// Usage: logging_bench [log_file] [lines_per_thread]
+//
+// On Mac/Android this drives Logger in cached mode, on Linux glog through
+// AsyncLogging.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "muduo-cpp11/base/async_logging.h"
+#include "muduo-cpp11/base/logging.h"
+
+namespace {
+
+void LogLines(const int lines) {
+  for (int i = 0; i < lines; ++i) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+    LogInfo("Hello 0123456789 abcdefghijklmnopqrstuvwxyz %d", i);
+#else
+    LOG(INFO) << "Hello 0123456789 abcdefghijklmnopqrstuvwxyz " << i;
+#endif
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string log_file = argc > 1 ? argv[1] : "/dev/null";
+  int lines = argc > 2 ? atoi(argv[2]) : 200000;
+
+#if defined(__MACH__) || defined(__ANDROID_API__)
+  muduo_cpp11::Logger::GetInstance().set_log_file_path(log_file);
+  muduo_cpp11::Logger::GetInstance().set_log_cached(true);
+#else
+  muduo_cpp11::AsyncLogging backend(log_file);
+  backend.set_overflow_policy(muduo_cpp11::AsyncLogging::kBlock);
+  if (!backend.Start()) {
+    return 1;
+  }
+  backend.RedirectGlog();
+#endif
+
+  for (int num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<std::thread>> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back(new std::thread(LogLines, lines));
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      threads[i]->join();
+    }
+
+#if defined(__MACH__) || defined(__ANDROID_API__)
+    muduo_cpp11::Logger::GetInstance().ForceSync();
+#else
+    backend.Flush();
+#endif
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%2d threads: %10.0f lines/s\n",
+           num_threads,
+           static_cast<double>(lines) * num_threads / seconds);
+  }
+
+  return 0;
+}
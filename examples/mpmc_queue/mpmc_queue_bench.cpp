@@ -0,0 +1,106 @@
+// Compares MpmcQueue with BlockingQueue: N producers and N consumers, N
+// from 1 to 32, pass items through one queue.
+//
+// Usage: mpmc_queue_bench [items_per_producer] [capacity]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "muduo-cpp11/base/blocking_queue.h"
+#include "muduo-cpp11/base/mpmc_queue.h"
+
+namespace {
+
+// Tells a consumer to exit.
+const int64_t kStop = -1;
+
+struct BlockingQueueAdapter {
+  explicit BlockingQueueAdapter(const size_t) {
+  }
+
+  void Put(const int64_t value) {
+    queue.Put(value);
+  }
+
+  int64_t Take() {
+    return queue.Take();
+  }
+
+  muduo_cpp11::BlockingQueue<int64_t> queue;
+};
+
+template <typename Queue>
+double Run(const int num_threads, const int items, const size_t capacity) {
+  Queue queue(capacity);
+  std::atomic<int64_t> sum(0);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<std::unique_ptr<std::thread>> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(new std::thread([&queue, &sum]() {
+      int64_t local_sum = 0;
+      for (;;) {
+        int64_t value = queue.Take();
+        if (value == kStop) {
+          break;
+        }
+        local_sum += value;
+      }
+      sum += local_sum;
+    }));
+  }
+
+  std::vector<std::unique_ptr<std::thread>> producers;
+  for (int i = 0; i < num_threads; ++i) {
+    producers.emplace_back(new std::thread([&queue, items]() {
+      for (int64_t j = 0; j < items; ++j) {
+        queue.Put(j);
+      }
+    }));
+  }
+
+  for (int i = 0; i < num_threads; ++i) {
+    producers[i]->join();
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    queue.Put(kStop);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i]->join();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  int64_t expected = static_cast<int64_t>(items) * (items - 1) / 2 * num_threads;
+  if (sum != expected) {
+    fprintf(stderr, "sum mismatch: %lld != %lld\n",
+            static_cast<long long>(sum.load()), static_cast<long long>(expected));
+    abort();
+  }
+
+  return static_cast<double>(items) * num_threads / seconds;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int items = argc > 1 ? atoi(argv[1]) : 200000;
+  size_t capacity = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 4096;
+
+  printf("%8s %18s %18s\n", "threads", "BlockingQueue/s", "MpmcQueue/s");
+  for (int num_threads = 1; num_threads <= 32; num_threads *= 2) {
+    double blocking = Run<BlockingQueueAdapter>(num_threads, items, capacity);
+    double mpmc = Run<muduo_cpp11::MpmcQueue<int64_t>>(num_threads, items, capacity);
+    printf("%3d x %-2d %18.0f %18.0f\n", num_threads, num_threads, blocking, mpmc);
+  }
+
+  return 0;
+}
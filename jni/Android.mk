@@ -3,6 +3,9 @@
 LOCAL_PATH := $(call my-dir)
 
 BASE_SRC_FILES := \
+    muduo-cpp11/base/async_logging.cpp 		\
+    muduo-cpp11/base/binary_logging.cpp 	\
+    muduo-cpp11/base/log_file.cpp 		\
     muduo-cpp11/base/logging.cpp 		\
     muduo-cpp11/base/thread_pool.cpp 		\
     muduo-cpp11/base/timestamp.cpp
@@ -15,12 +18,15 @@ NET_SRC_FILES := \
     muduo-cpp11/net/event_loop.cpp 		\
     muduo-cpp11/net/event_loop_thread.cpp 	\
     muduo-cpp11/net/event_loop_thread_pool.cpp 	\
+    muduo-cpp11/net/idle_connection_reaper.cpp 	\
     muduo-cpp11/net/inet_address.cpp 		\
+    muduo-cpp11/net/offload_pipeline.cpp 	\
     muduo-cpp11/net/poller.cpp 			\
     muduo-cpp11/net/socket.cpp 			\
     muduo-cpp11/net/sockets_ops.cpp 		\
     muduo-cpp11/net/tcp_client.cpp 		\
     muduo-cpp11/net/tcp_connection.cpp 		\
+    muduo-cpp11/net/tcp_connection_pool.cpp 	\
     muduo-cpp11/net/tcp_server.cpp 		\
     muduo-cpp11/net/timer.cpp 			\
     muduo-cpp11/net/timer_queue.cpp 		\
@@ -0,0 +1,429 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/base/async_logging.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+
+#include "muduo-cpp11/base/logging.h"
+
+namespace muduo_cpp11 {
+
+namespace {
+
+const size_t kBufferSize = 256 * 1024;
+
+std::atomic<uint64_t> g_next_instance_id(1);
+
+}  // namespace
+
+struct AsyncLogging::Buffer {
+  Buffer() : len(0) {
+  }
+
+  size_t avail() const {
+    return kBufferSize - len;
+  }
+
+  size_t len;
+  char data[kBufferSize];
+};
+
+struct AsyncLogging::ThreadBuffer {
+  std::mutex mutex;
+  BufferPtr current;
+};
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+// glog hands every message to the logger of its own severity and of all
+// lower severities, so only the INFO logger forwards to the backend and the
+// others discard, otherwise a WARNING would be written twice.
+struct AsyncLogging::GlogRedirect {
+  class Sink : public google::base::Logger {
+   public:
+    explicit Sink(AsyncLogging* backend) : backend_(backend) {
+    }
+
+    virtual void Write(bool force_flush,
+                       time_t timestamp,
+                       const char* message,
+                       int message_len) {
+      if (backend_ == NULL) {
+        return;
+      }
+
+      if (message_len > 0) {
+        backend_->Append(message, message_len);
+      } else if (force_flush) {
+        // glog sends an empty forced write right before aborting on FATAL.
+        backend_->Flush();
+      }
+    }
+
+    virtual void Flush() {
+      if (backend_ != NULL) {
+        backend_->Flush();
+      }
+    }
+
+    virtual google::uint32 LogSize() {
+      return backend_ != NULL ? static_cast<google::uint32>(backend_->written_bytes()) : 0;
+    }
+
+   private:
+    AsyncLogging* backend_;
+  };
+
+  std::vector<google::base::Logger*> previous;
+  std::vector<std::unique_ptr<Sink>> sinks;
+};
+#endif
+
+AsyncLogging::AsyncLogging(const std::string& path)
+    : fd_(-1),
+      id_(g_next_instance_id++),
+      path_(path),
+      flush_interval_(3),
+      max_pending_buffers_(16),
+      overflow_policy_(kDropNewest),
+      running_(false),
+      dropped_bytes_(0),
+      flush_requested_(0),
+      flush_done_(0),
+      total_dropped_bytes_(0),
+      written_bytes_(0) {
+}
+
+AsyncLogging::~AsyncLogging() {
+  Stop();
+
+  if (fd_ >= 0 && fd_ != STDERR_FILENO) {
+    close(fd_);
+  }
+}
+
+bool AsyncLogging::Start() {
+  assert(!running_);
+  if (running_) {
+    return true;
+  }
+
+  if (fd_ < 0 && !output_callback_) {
+    if (path_.empty()) {
+      fd_ = STDERR_FILENO;
+    } else if ((fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+      fprintf(stderr,
+              "Open log file \"%s\" to write fail, errno: %d, error info: %s\n",
+              path_.c_str(),
+              errno,
+              strerror_tl(errno).c_str());
+      return false;
+    }
+  }
+
+  if (max_pending_buffers_ == 0) {
+    max_pending_buffers_ = 1;
+  }
+
+  if (flush_interval_ <= 0) {
+    flush_interval_ = 1;
+  }
+
+  running_ = true;
+  thread_.reset(new std::thread(std::bind(&AsyncLogging::ThreadFunc, this)));
+  return true;
+}
+
+void AsyncLogging::Stop() {
+  if (!running_) {
+    return;
+  }
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+  RestoreGlog();
+#endif
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    cond_.notify_all();
+    not_full_.notify_all();
+    flushed_.notify_all();
+  }
+
+  thread_->join();
+  thread_.reset();
+}
+
+void AsyncLogging::Append(const char* msg, size_t len) {
+  if (!running_) {
+    // Not started yet or already stopped, keep the message anyway.
+    Output(msg, len);
+    return;
+  }
+
+  ThreadBuffer* thread_buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+
+  if (thread_buffer->current->avail() < len) {
+    HandOver(thread_buffer);
+  }
+
+  if (len > kBufferSize) {
+    len = kBufferSize;
+  }
+
+  Buffer* buffer = thread_buffer->current.get();
+  if (buffer->avail() >= len) {
+    memcpy(buffer->data + buffer->len, msg, len);
+    buffer->len += len;
+  }
+}
+
+void AsyncLogging::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!running_) {
+    return;
+  }
+
+  uint64_t target = ++flush_requested_;
+  cond_.notify_one();
+  flushed_.wait(lock, [this, target] () {
+    return flush_done_ >= target || !running_;
+  });
+}
+
+AsyncLogging::ThreadBuffer* AsyncLogging::GetThreadBuffer() {
+  // Keyed by instance id rather than by this, so a new AsyncLogging that
+  // happens to reuse the address of a destroyed one does not pick up a
+  // buffer it never registered.
+  static thread_local uint64_t t_owner_id = 0;
+  static thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+  if (t_owner_id != id_) {
+    std::shared_ptr<ThreadBuffer> thread_buffer(new ThreadBuffer);
+    thread_buffer->current.reset(new Buffer);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      thread_buffers_.push_back(thread_buffer);
+    }
+    t_buffer.swap(thread_buffer);
+    t_owner_id = id_;
+  }
+
+  return t_buffer.get();
+}
+
+void AsyncLogging::HandOver(ThreadBuffer* thread_buffer) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (pending_buffers_.size() >= max_pending_buffers_) {
+    if (overflow_policy_ == kDropNewest || !running_) {
+      dropped_bytes_ += thread_buffer->current->len;
+      total_dropped_bytes_ += thread_buffer->current->len;
+      thread_buffer->current->len = 0;
+      return;
+    }
+
+    not_full_.wait(lock);
+  }
+
+  pending_buffers_.push_back(std::move(thread_buffer->current));
+  if (!free_buffers_.empty()) {
+    thread_buffer->current = std::move(free_buffers_.back());
+    free_buffers_.pop_back();
+  } else {
+    thread_buffer->current.reset(new Buffer);
+  }
+
+  cond_.notify_one();
+}
+
+void AsyncLogging::CollectThreadBuffers() {
+  std::vector<std::shared_ptr<ThreadBuffer>> thread_buffers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_buffers.reserve(thread_buffers_.size());
+    for (size_t i = 0; i < thread_buffers_.size();) {
+      // The owner thread has exited, this is the last chance to drain it.
+      bool exited = thread_buffers_[i].use_count() == 1;
+      thread_buffers.push_back(thread_buffers_[i]);
+
+      if (exited) {
+        thread_buffers_[i] = thread_buffers_.back();
+        thread_buffers_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < thread_buffers.size(); ++i) {
+    ThreadBuffer* thread_buffer = thread_buffers[i].get();
+
+    // A producer blocked in HandOver() holds its own lock, so never wait
+    // for it here; a busy thread will hand its buffer over by itself.
+    std::unique_lock<std::mutex> thread_lock(thread_buffer->mutex, std::try_to_lock);
+    if (!thread_lock.owns_lock() || thread_buffer->current->len == 0) {
+      continue;
+    }
+
+    // Queue behind anything the thread handed over earlier, so the lines
+    // of one thread always reach the file in order.
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_buffers_.push_back(std::move(thread_buffer->current));
+    if (!free_buffers_.empty()) {
+      thread_buffer->current = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    } else {
+      thread_buffer->current.reset(new Buffer);
+    }
+  }
+}
+
+void AsyncLogging::WriteBuffers(const BufferVector& buffers, const uint64_t dropped) {
+  if (dropped > 0) {
+    char note[128];
+    int len = snprintf(note,
+                       sizeof note,
+                       "AsyncLogging dropped %" PRIu64 " bytes of log messages\n",
+                       dropped);
+    Output(note, len);
+  }
+
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    Output(buffers[i]->data, buffers[i]->len);
+  }
+}
+
+void AsyncLogging::Output(const char* data, size_t len) {
+  if (output_callback_) {
+    output_callback_(data, len);
+    written_bytes_ += len;
+    return;
+  }
+
+  int fd = fd_ >= 0 ? fd_ : STDERR_FILENO;
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      fprintf(stderr,
+              "file: " __FILE__ ", line: %d, call write fail, errno: %d, error info: %s\n",
+              __LINE__,
+              errno,
+              strerror_tl(errno).c_str());
+      return;
+    }
+
+    data += n;
+    len -= n;
+    written_bytes_ += n;
+  }
+}
+
+void AsyncLogging::ThreadFunc() {
+  const std::chrono::seconds flush_interval(flush_interval_);
+  std::chrono::steady_clock::time_point last_collect = std::chrono::steady_clock::now();
+  BufferVector buffers;
+
+  while (running_) {
+    uint64_t flush_target = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (pending_buffers_.empty() && flush_requested_ == flush_done_) {
+        cond_.wait_for(lock, flush_interval);
+      }
+      flush_target = flush_requested_;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (flush_target != flush_done_ || now - last_collect >= flush_interval) {
+      CollectThreadBuffers();
+      last_collect = now;
+    }
+
+    uint64_t dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffers.swap(pending_buffers_);
+      dropped = dropped_bytes_;
+      dropped_bytes_ = 0;
+      not_full_.notify_all();
+    }
+
+    WriteBuffers(buffers, dropped);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < buffers.size(); ++i) {
+        if (free_buffers_.size() < max_pending_buffers_) {
+          buffers[i]->len = 0;
+          free_buffers_.push_back(std::move(buffers[i]));
+        }
+      }
+
+      flush_done_ = flush_target;
+      flushed_.notify_all();
+    }
+
+    buffers.clear();
+  }
+
+  // Stopped, write whatever is left.
+  CollectThreadBuffers();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers.swap(pending_buffers_);
+    WriteBuffers(buffers, dropped_bytes_);
+    dropped_bytes_ = 0;
+  }
+}
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+void AsyncLogging::RedirectGlog() {
+  assert(running_);
+  if (glog_redirect_) {
+    return;
+  }
+
+  glog_redirect_.reset(new GlogRedirect);
+  for (int severity = google::GLOG_INFO; severity < google::NUM_SEVERITIES; ++severity) {
+    glog_redirect_->sinks.emplace_back(
+        new GlogRedirect::Sink(severity == google::GLOG_INFO ? this : NULL));
+    glog_redirect_->previous.push_back(google::base::GetLogger(severity));
+    google::base::SetLogger(severity, glog_redirect_->sinks.back().get());
+  }
+}
+
+void AsyncLogging::RestoreGlog() {
+  if (!glog_redirect_) {
+    return;
+  }
+
+  // SetLogger() takes the same lock glog holds while calling Write(), so
+  // once it returns no thread is inside our sinks any more.
+  for (int severity = google::GLOG_INFO; severity < google::NUM_SEVERITIES; ++severity) {
+    google::base::SetLogger(severity, glog_redirect_->previous[severity]);
+  }
+
+  glog_redirect_.reset();
+}
+#endif
+
+}  // namespace muduo_cpp11
@@ -0,0 +1,158 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_ASYNC_LOGGING_H_
+#define MUDUO_CPP11_BASE_ASYNC_LOGGING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+
+namespace muduo_cpp11 {
+
+/// Asynchronous log backend.
+///
+/// Every thread that calls Append() gets its own buffer, so producers never
+/// contend with each other. A full buffer is handed over to a background
+/// writer thread, which swaps the whole pending list out under one lock and
+/// writes it to the log file without blocking the producers. Partially
+/// filled buffers are collected every flush_interval seconds.
+///
+/// Memory is bounded: at most max_pending_buffers full buffers may wait for
+/// the writer. When that limit is hit, kDropNewest discards the new buffer
+/// (and the writer reports how many bytes were lost), kBlock makes the
+/// producer wait for the writer.
+///
+/// On Linux, RedirectGlog() makes the LOG() macros write through this
+/// backend instead of glog's synchronous file writer.
+class AsyncLogging {
+ public:
+  enum OverflowPolicy {
+    kDropNewest,
+    kBlock,
+  };
+
+  typedef std::function<void (const char* data, size_t len)> OutputCallback;
+
+  /// Writes to @path, or to stderr if @path is empty.
+  explicit AsyncLogging(const std::string& path);
+  ~AsyncLogging();
+
+  // Must be called before Start().
+  void set_flush_interval(const int seconds) {
+    flush_interval_ = seconds;
+  }
+
+  void set_max_pending_buffers(const size_t max_buffers) {
+    max_pending_buffers_ = max_buffers;
+  }
+
+  void set_overflow_policy(const OverflowPolicy policy) {
+    overflow_policy_ = policy;
+  }
+
+  /// Hands the log data to @cb in the writer thread instead of writing
+  /// the file given to the constructor, e.g. LogFile::Append for a
+  /// rolling file.
+  void set_output_callback(const OutputCallback& cb) {
+    output_callback_ = cb;
+  }
+
+  bool Start();
+  void Stop();
+
+  /// Thread safe. @msg should end with '\n'.
+  void Append(const char* msg, size_t len);
+
+  /// Blocks until everything appended before the call has been written.
+  void Flush();
+
+  /// Total bytes dropped under kDropNewest.
+  uint64_t dropped_bytes() const {
+    return total_dropped_bytes_;
+  }
+
+  uint64_t written_bytes() const {
+    return written_bytes_;
+  }
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+  /// Routes every glog severity to this backend. Must be called after
+  /// Start(); the previous glog loggers are restored in Stop().
+  /// NOTE: glog bypasses its loggers entirely when FLAGS_logtostderr is set.
+  void RedirectGlog();
+#endif
+
+ private:
+  struct Buffer;
+  struct ThreadBuffer;
+  typedef std::unique_ptr<Buffer> BufferPtr;
+  typedef std::vector<BufferPtr> BufferVector;
+
+  ThreadBuffer* GetThreadBuffer();
+
+  // Called with the thread buffer's lock held.
+  void HandOver(ThreadBuffer* thread_buffer);
+
+  // Moves non-empty thread buffers to pending_buffers_.
+  void CollectThreadBuffers();
+  void WriteBuffers(const BufferVector& buffers, const uint64_t dropped);
+  void Output(const char* data, size_t len);
+
+  void ThreadFunc();
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+  struct GlogRedirect;
+  void RestoreGlog();
+#endif
+
+ private:
+  int fd_;
+  const uint64_t id_;
+  std::string path_;
+  int flush_interval_;
+  size_t max_pending_buffers_;
+  OverflowPolicy overflow_policy_;
+  OutputCallback output_callback_;
+
+  std::atomic<bool> running_;
+  std::unique_ptr<std::thread> thread_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable not_full_;
+  std::condition_variable flushed_;
+
+  // Guarded by mutex_.
+  BufferVector pending_buffers_;
+  BufferVector free_buffers_;
+  std::vector<std::shared_ptr<ThreadBuffer>> thread_buffers_;
+  uint64_t dropped_bytes_;
+  uint64_t flush_requested_;
+  uint64_t flush_done_;
+
+  std::atomic<uint64_t> total_dropped_bytes_;
+  std::atomic<uint64_t> written_bytes_;
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+  std::unique_ptr<GlogRedirect> glog_redirect_;
+#endif
+
+  DISABLE_COPY_AND_ASSIGN(AsyncLogging);
+};
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_ASYNC_LOGGING_H_
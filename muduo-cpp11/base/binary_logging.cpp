@@ -0,0 +1,385 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/base/binary_logging.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+
+using std::string;
+
+namespace muduo_cpp11 {
+
+namespace binlog {
+
+string Format(const char* format, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(buf, sizeof buf, format, ap);
+  va_end(ap);
+
+  if (len < 0) {
+    return string();
+  }
+
+  if (static_cast<size_t>(len) < sizeof buf) {
+    return string(buf, len);
+  }
+
+  string text(len + 1, '\0');
+  va_start(ap, format);
+  vsnprintf(&text[0], text.size(), format, ap);
+  va_end(ap);
+  text.resize(len);
+  return text;
+}
+
+}  // namespace binlog
+
+namespace {
+
+const size_t kDefaultRingSize = 1024 * 1024;
+const size_t kOutputFlushSize = 64 * 1024;
+
+std::atomic<uint64_t> g_next_instance_id(1);
+
+struct SiteRegistry {
+  std::mutex mutex;
+  std::vector<const binlog::LogSite*> sites;
+};
+
+// Call sites register during static initialization of other translation
+// units too, so the registry must not depend on initialization order.
+SiteRegistry& GetSiteRegistry() {
+  static SiteRegistry registry;
+  return registry;
+}
+
+void AppendRaw(string* output, const void* data, size_t len) {
+  output->append(static_cast<const char*>(data), len);
+}
+
+void AppendString16(string* output, const char* str) {
+  uint16_t len = static_cast<uint16_t>(strlen(str));
+  AppendRaw(output, &len, sizeof len);
+  output->append(str, len);
+}
+
+}  // namespace
+
+// Single producer (the owner thread), single consumer (the writer thread).
+// head and tail only grow; a record never wraps, the space left at the end
+// of the ring is skipped with a padding record whose site id is 0.
+struct BinaryLogging::Ring {
+  explicit Ring(const size_t ring_size)
+      : size(ring_size),
+        data(new char[ring_size]),
+        tid(gettid()),
+        head(0),
+        tail(0),
+        dropped(0),
+        dropped_reported(0) {
+  }
+
+  const size_t size;
+  std::unique_ptr<char[]> data;
+  const pid_t tid;
+
+  std::atomic<uint64_t> head;
+  char head_padding[64];
+  std::atomic<uint64_t> tail;
+  char tail_padding[64];
+
+  std::atomic<uint64_t> dropped;
+  // Only touched by the writer thread.
+  uint64_t dropped_reported;
+};
+
+struct BinaryLogging::RingHolder {
+  RingHolder() : owner_id(0) {
+  }
+
+  // Not the BinaryLogging pointer, a new one may reuse the address of a
+  // destroyed one.
+  uint64_t owner_id;
+  std::shared_ptr<Ring> ring;
+};
+
+std::atomic<BinaryLogging*> BinaryLogging::instance_(NULL);
+BinaryLogging::PinCount BinaryLogging::pin_counts_[kPinCountShards];
+std::atomic<uint32_t> BinaryLogging::next_pin_count_(0);
+
+BinaryLogging::BinaryLogging(const string& path)
+    : fd_(-1),
+      id_(g_next_instance_id++),
+      path_(path),
+      ring_size_(kDefaultRingSize),
+      drain_interval_ms_(100),
+      running_(false),
+      sites_written_(0) {
+}
+
+BinaryLogging::~BinaryLogging() {
+  Stop();
+
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void BinaryLogging::set_ring_size(const size_t ring_size) {
+  size_t size = 4096;
+  while (size < ring_size) {
+    size <<= 1;
+  }
+  ring_size_ = size;
+}
+
+bool BinaryLogging::Start() {
+  assert(!running_);
+  if (running_) {
+    return true;
+  }
+
+  if ((fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(stderr,
+            "Open log file \"%s\" to write fail, errno: %d, error info: %s\n",
+            path_.c_str(),
+            errno,
+            strerror_tl(errno).c_str());
+    return false;
+  }
+
+  BinaryLogging* expected = NULL;
+  if (!instance_.compare_exchange_strong(expected, this)) {
+    fprintf(stderr, "Another BinaryLogging is running\n");
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  output_.assign(binlog::kFileMagic, sizeof binlog::kFileMagic);
+  running_ = true;
+  thread_.reset(new std::thread(std::bind(&BinaryLogging::ThreadFunc, this)));
+  return true;
+}
+
+void BinaryLogging::Stop() {
+  if (!running_) {
+    return;
+  }
+
+  // Call sites which got this in a ScopedInstance may still be logging,
+  // and may register a new ring: wait for them, their records are drained
+  // below.
+  instance_.store(NULL, std::memory_order_seq_cst);
+  for (int i = 0; i < kPinCountShards; ++i) {
+    while (pin_counts_[i].count.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    cond_.notify_all();
+  }
+
+  thread_->join();
+  thread_.reset();
+}
+
+uint32_t BinaryLogging::RegisterSite(const binlog::LogSite* site) {
+  SiteRegistry& registry = GetSiteRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.sites.push_back(site);
+  return static_cast<uint32_t>(registry.sites.size());
+}
+
+BinaryLogging::Ring* BinaryLogging::GetRing() {
+  static thread_local RingHolder t_holder;
+
+  if (t_holder.owner_id != id_) {
+    std::shared_ptr<Ring> ring = std::make_shared<Ring>(ring_size_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      rings_.push_back(ring);
+    }
+    t_holder.ring.swap(ring);
+    t_holder.owner_id = id_;
+  }
+
+  return t_holder.ring.get();
+}
+
+char* BinaryLogging::Reserve(Ring* ring, const size_t size) {
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  size_t offset = static_cast<size_t>(head & (ring->size - 1));
+  size_t contiguous = ring->size - offset;
+  size_t padding = contiguous < size ? contiguous : 0;
+
+  if (size > ring->size / 2 || head + padding + size - tail > ring->size) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+
+  if (padding > 0) {
+    uint32_t padding_size = static_cast<uint32_t>(padding);
+    uint32_t site_id = 0;
+    memcpy(ring->data.get() + offset, &padding_size, 4);
+    memcpy(ring->data.get() + offset + 4, &site_id, 4);
+    ring->head.store(head + padding, std::memory_order_release);
+    offset = 0;
+  }
+
+  return ring->data.get() + offset;
+}
+
+void BinaryLogging::Commit(Ring* ring, const size_t size) {
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->head.store(head + size, std::memory_order_release);
+}
+
+void BinaryLogging::Drain(Ring* ring) {
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+
+  // The sites of the records seen above registered before they were
+  // logged, so they are all known now.
+  WriteSites();
+
+  if (tail != head) {
+    output_.push_back(static_cast<char>(binlog::kRecordsEntry));
+    int32_t tid = ring->tid;
+    AppendRaw(&output_, &tid, sizeof tid);
+    size_t bytes_pos = output_.size();
+    uint32_t bytes = 0;
+    AppendRaw(&output_, &bytes, sizeof bytes);
+
+    while (tail != head) {
+      const char* record = ring->data.get() + (tail & (ring->size - 1));
+      uint32_t size = 0;
+      uint32_t site_id = 0;
+      memcpy(&size, record, 4);
+      memcpy(&site_id, record + 4, 4);
+      if (site_id != 0) {
+        output_.append(record, size);
+        bytes += size;
+      }
+      tail += size;
+    }
+
+    memcpy(&output_[bytes_pos], &bytes, sizeof bytes);
+    ring->tail.store(tail, std::memory_order_release);
+  }
+
+  uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+  if (dropped != ring->dropped_reported) {
+    output_.push_back(static_cast<char>(binlog::kDroppedEntry));
+    int32_t tid = ring->tid;
+    uint64_t count = dropped - ring->dropped_reported;
+    AppendRaw(&output_, &tid, sizeof tid);
+    AppendRaw(&output_, &count, sizeof count);
+    ring->dropped_reported = dropped;
+  }
+
+  if (output_.size() >= kOutputFlushSize) {
+    Output(output_.data(), output_.size());
+    output_.clear();
+  }
+}
+
+void BinaryLogging::WriteSites() {
+  SiteRegistry& registry = GetSiteRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  for (; sites_written_ < registry.sites.size(); ++sites_written_) {
+    const binlog::LogSite* site = registry.sites[sites_written_];
+    uint32_t id = sites_written_ + 1;
+    int32_t line = site->line;
+    uint32_t format_len = static_cast<uint32_t>(strlen(site->format));
+
+    output_.push_back(static_cast<char>(binlog::kSiteEntry));
+    AppendRaw(&output_, &id, sizeof id);
+    AppendRaw(&output_, &line, sizeof line);
+    AppendString16(&output_, site->severity);
+    AppendString16(&output_, site->file);
+    AppendRaw(&output_, &format_len, sizeof format_len);
+    output_.append(site->format, format_len);
+  }
+}
+
+void BinaryLogging::Output(const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd_, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      fprintf(stderr,
+              "file: " __FILE__ ", line: %d, call write fail, errno: %d, error info: %s\n",
+              __LINE__,
+              errno,
+              strerror_tl(errno).c_str());
+      return;
+    }
+
+    data += n;
+    len -= n;
+  }
+}
+
+void BinaryLogging::ThreadFunc() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  bool stopping = false;
+
+  while (!stopping) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (running_) {
+        cond_.wait_for(lock, std::chrono::milliseconds(drain_interval_ms_));
+      }
+      stopping = !running_;
+      rings = rings_;
+    }
+
+    for (size_t i = 0; i < rings.size(); ++i) {
+      // rings_, the local copy and the owner thread's holder.
+      bool exited = rings[i].use_count() == 2;
+      Drain(rings[i].get());
+
+      // The owner thread has exited and the ring is drained for good.
+      if (exited) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t j = 0; j < rings_.size(); ++j) {
+          if (rings_[j] == rings[i]) {
+            rings_[j] = rings_.back();
+            rings_.pop_back();
+            break;
+          }
+        }
+      }
+    }
+    rings.clear();
+
+    WriteSites();
+    if (!output_.empty()) {
+      Output(output_.data(), output_.size());
+      output_.clear();
+    }
+  }
+}
+
+}  // namespace muduo_cpp11
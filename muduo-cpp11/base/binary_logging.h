@@ -0,0 +1,350 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_BINARY_LOGGING_H_
+#define MUDUO_CPP11_BASE_BINARY_LOGGING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "muduo-cpp11/base/logging.h"
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/timestamp.h"
+
+namespace muduo_cpp11 {
+
+namespace binlog {
+
+/// Static description of one BINLOG() call site, registered once.
+struct LogSite {
+  const char* severity;
+  const char* file;
+  int line;
+  const char* format;
+};
+
+// File layout, shared with the muduo_logdecode tool:
+//
+//   kFileMagic, then a sequence of entries, each starting with a kind byte.
+//
+//   kSiteEntry:    uint32 id, int32 line, uint16 + severity, uint16 + file,
+//                  uint32 + format
+//   kRecordsEntry: int32 tid, uint32 bytes, records
+//   kDroppedEntry: int32 tid, uint64 number of records dropped
+//
+// A record is: uint32 size (multiple of 8, header included), uint32 site
+// id, int64 microseconds since epoch, then one tagged value per argument.
+// Integers are widened to 64 bits; a string is uint32 length + bytes.
+// Everything is in host byte order.
+const char kFileMagic[8] = { 'M', 'U', 'D', 'U', 'O', 'B', 'L', '1' };
+
+enum EntryKind {
+  kSiteEntry = 1,
+  kRecordsEntry = 2,
+  kDroppedEntry = 3,
+};
+
+enum ArgType {
+  kIntArg = 1,
+  kUintArg = 2,
+  kDoubleArg = 3,
+  kStringArg = 4,
+  kPointerArg = 5,
+};
+
+const size_t kRecordHeaderSize = 16;
+
+/// Formats like sprintf, used when binary logging is not enabled.
+std::string Format(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+inline size_t ArgSize(const char* value) {
+  return 1 + 4 + (value != NULL ? strlen(value) : 0);
+}
+
+inline size_t ArgSize(const void*) {
+  return 1 + 8;
+}
+
+inline size_t ArgSize(double) {
+  return 1 + 8;
+}
+
+inline size_t ArgSize(long long) {
+  return 1 + 8;
+}
+
+inline size_t ArgSize(unsigned long long) {
+  return 1 + 8;
+}
+
+inline size_t ArgSize(bool) { return ArgSize(0LL); }
+inline size_t ArgSize(char) { return ArgSize(0LL); }
+inline size_t ArgSize(signed char) { return ArgSize(0LL); }
+inline size_t ArgSize(short) { return ArgSize(0LL); }
+inline size_t ArgSize(int) { return ArgSize(0LL); }
+inline size_t ArgSize(long) { return ArgSize(0LL); }
+inline size_t ArgSize(unsigned char) { return ArgSize(0ULL); }
+inline size_t ArgSize(unsigned short) { return ArgSize(0ULL); }
+inline size_t ArgSize(unsigned int) { return ArgSize(0ULL); }
+inline size_t ArgSize(unsigned long) { return ArgSize(0ULL); }
+inline size_t ArgSize(float) { return ArgSize(0.0); }
+
+inline char* EncodeArg(char* buf, const char* value) {
+  uint32_t len = value != NULL ? static_cast<uint32_t>(strlen(value)) : 0;
+  *buf = kStringArg;
+  memcpy(buf + 1, &len, 4);
+  memcpy(buf + 5, value, len);
+  return buf + 5 + len;
+}
+
+inline char* EncodeArg(char* buf, const void* value) {
+  uint64_t v = reinterpret_cast<uintptr_t>(value);
+  *buf = kPointerArg;
+  memcpy(buf + 1, &v, 8);
+  return buf + 9;
+}
+
+inline char* EncodeArg(char* buf, double value) {
+  *buf = kDoubleArg;
+  memcpy(buf + 1, &value, 8);
+  return buf + 9;
+}
+
+inline char* EncodeArg(char* buf, long long value) {
+  int64_t v = value;
+  *buf = kIntArg;
+  memcpy(buf + 1, &v, 8);
+  return buf + 9;
+}
+
+inline char* EncodeArg(char* buf, unsigned long long value) {
+  uint64_t v = value;
+  *buf = kUintArg;
+  memcpy(buf + 1, &v, 8);
+  return buf + 9;
+}
+
+inline char* EncodeArg(char* buf, bool value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, char value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, signed char value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, short value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, int value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, long value) { return EncodeArg(buf, static_cast<long long>(value)); }
+inline char* EncodeArg(char* buf, unsigned char value) { return EncodeArg(buf, static_cast<unsigned long long>(value)); }
+inline char* EncodeArg(char* buf, unsigned short value) { return EncodeArg(buf, static_cast<unsigned long long>(value)); }
+inline char* EncodeArg(char* buf, unsigned int value) { return EncodeArg(buf, static_cast<unsigned long long>(value)); }
+inline char* EncodeArg(char* buf, unsigned long value) { return EncodeArg(buf, static_cast<unsigned long long>(value)); }
+inline char* EncodeArg(char* buf, float value) { return EncodeArg(buf, static_cast<double>(value)); }
+
+inline size_t ArgsSize() {
+  return 0;
+}
+
+template <typename T, typename... Args>
+size_t ArgsSize(const T& value, const Args&... args) {
+  return ArgSize(value) + ArgsSize(args...);
+}
+
+inline char* EncodeArgs(char* buf) {
+  return buf;
+}
+
+template <typename T, typename... Args>
+char* EncodeArgs(char* buf, const T& value, const Args&... args) {
+  return EncodeArgs(EncodeArg(buf, value), args...);
+}
+
+}  // namespace binlog
+
+/// Binary logging with deferred formatting.
+///
+/// A BINLOG() call site only copies a static site id, a timestamp and its
+/// raw arguments into a per-thread single-producer ring, without any text
+/// formatting or shared lock. A background thread drains the rings into a
+/// binary file, which the muduo_logdecode tool turns back into text.
+///
+/// A record that does not fit in the ring is dropped rather than blocking
+/// the caller; the number of dropped records is written to the file.
+///
+/// When no BinaryLogging is started, BINLOG() formats the message and
+/// passes it to the text logger instead.
+class BinaryLogging {
+ public:
+  explicit BinaryLogging(const std::string& path);
+  ~BinaryLogging();
+
+  // Must be called before Start(). Rounded up to a power of two.
+  void set_ring_size(const size_t ring_size);
+
+  void set_drain_interval_ms(const int interval_ms) {
+    drain_interval_ms_ = interval_ms;
+  }
+
+  /// Starts the writer thread and routes BINLOG() here. Only one
+  /// BinaryLogging can be started at a time.
+  bool Start();
+  /// Waits for the call sites logging here to finish, so the object may
+  /// be destroyed afterwards, then drains their records.
+  void Stop();
+
+  /// Logging through it races with Stop(), see ScopedInstance.
+  static BinaryLogging* instance() {
+    return instance_.load(std::memory_order_acquire);
+  }
+
+  ///
+  /// The started BinaryLogging, if any, kept from being stopped until
+  /// destructed. Costs an atomic increment and decrement of a counter
+  /// shared with few other threads, and nothing when none is started.
+  class ScopedInstance {
+   public:
+    ScopedInstance()
+        : count_(NULL),
+          logging_(NULL) {
+      if (instance_.load(std::memory_order_relaxed) != NULL) {
+        // Pairs with Stop(): either it sees the count, or we see NULL.
+        count_ = ThreadPinCount();
+        count_->fetch_add(1, std::memory_order_seq_cst);
+        logging_ = instance_.load(std::memory_order_seq_cst);
+      }
+    }
+
+    ~ScopedInstance() {
+      if (count_ != NULL) {
+        count_->fetch_sub(1, std::memory_order_release);
+      }
+    }
+
+    BinaryLogging* get() const {
+      return logging_;
+    }
+
+   private:
+    std::atomic<int>* count_;
+    BinaryLogging* logging_;
+
+    DISABLE_COPY_AND_ASSIGN(ScopedInstance);
+  };
+
+  static uint32_t RegisterSite(const binlog::LogSite* site);
+
+  template <typename... Args>
+  void Log(const uint32_t site_id, const Args&... args) {
+    size_t size = binlog::kRecordHeaderSize + binlog::ArgsSize(args...);
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    Ring* ring = GetRing();
+    char* buf = Reserve(ring, size);
+    if (buf == NULL) {
+      return;
+    }
+
+    uint32_t record_size = static_cast<uint32_t>(size);
+    int64_t now = Timestamp::Now().microseconds_since_epoch();
+    memcpy(buf, &record_size, 4);
+    memcpy(buf + 4, &site_id, 4);
+    memcpy(buf + 8, &now, 8);
+    binlog::EncodeArgs(buf + binlog::kRecordHeaderSize, args...);
+    Commit(ring, size);
+  }
+
+ private:
+  struct Ring;
+  struct RingHolder;
+
+  Ring* GetRing();
+
+  // Returns NULL if the ring is full.
+  char* Reserve(Ring* ring, const size_t size);
+  void Commit(Ring* ring, const size_t size);
+
+  void Drain(Ring* ring);
+  void WriteSites();
+  void Output(const char* data, size_t len);
+
+  void ThreadFunc();
+
+  // Call sites in ScopedInstance, counted in a few cache lines rather
+  // than one shared by all threads.
+  static const int kPinCountShards = 16;
+
+  struct PinCount {
+    std::atomic<int> count;
+    char padding[64 - sizeof(std::atomic<int>)];
+  };
+
+  static std::atomic<int>* ThreadPinCount() {
+    static thread_local std::atomic<int>* t_count = NULL;
+    if (t_count == NULL) {
+      t_count = &pin_counts_[next_pin_count_.fetch_add(1) % kPinCountShards].count;
+    }
+    return t_count;
+  }
+
+ private:
+  static std::atomic<BinaryLogging*> instance_;
+  static PinCount pin_counts_[kPinCountShards];
+  static std::atomic<uint32_t> next_pin_count_;
+
+  int fd_;
+  const uint64_t id_;
+  std::string path_;
+  size_t ring_size_;
+  int drain_interval_ms_;
+
+  std::atomic<bool> running_;
+  std::unique_ptr<std::thread> thread_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+
+  // Only touched by the writer thread.
+  uint32_t sites_written_;
+  std::string output_;
+
+  DISABLE_COPY_AND_ASSIGN(BinaryLogging);
+};
+
+}  // namespace muduo_cpp11
+
+#if defined(__MACH__) || defined(__ANDROID_API__)
+#define MUDUO_BINLOG_TEXT_INFO LogInfo
+#define MUDUO_BINLOG_TEXT_WARNING LogWarn
+#define MUDUO_BINLOG_TEXT_ERROR LogError
+#define MUDUO_BINLOG_TEXT(severity, format, ...) \
+  { MUDUO_BINLOG_TEXT_##severity("%s", ::muduo_cpp11::binlog::Format(format, ##__VA_ARGS__).c_str()); }
+#else
+#define MUDUO_BINLOG_TEXT(severity, format, ...) \
+  LOG(severity) << ::muduo_cpp11::binlog::Format(format, ##__VA_ARGS__)
+#endif
+
+// printf-style logging with deferred formatting, severity is one of INFO,
+// WARNING and ERROR. Arguments must be integers, floating point numbers,
+// C strings or pointers.
+#define BINLOG(severity, format, ...) \
+  do { \
+    static const ::muduo_cpp11::binlog::LogSite muduo_binlog_site = { \
+        #severity, __FILE__, __LINE__, format }; \
+    static const uint32_t muduo_binlog_site_id = \
+        ::muduo_cpp11::BinaryLogging::RegisterSite(&muduo_binlog_site); \
+    ::muduo_cpp11::BinaryLogging::ScopedInstance muduo_binlog; \
+    if (muduo_binlog.get() != NULL) { \
+      muduo_binlog.get()->Log(muduo_binlog_site_id, ##__VA_ARGS__); \
+    } else { \
+      MUDUO_BINLOG_TEXT(severity, format, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#endif  // MUDUO_CPP11_BASE_BINARY_LOGGING_H_
@@ -0,0 +1,214 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_EVENT_COUNT_H_
+#define MUDUO_CPP11_BASE_EVENT_COUNT_H_
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#endif
+
+#include "muduo-cpp11/base/macros.h"
+
+namespace muduo_cpp11 {
+
+/// Lets threads sleep until "something changed" without a lock on the
+/// notify side. Notify is a fence and an atomic load while nobody waits;
+/// otherwise it takes waiters off the list under a mutex and wakes each
+/// one on its own futex(2) word on Linux, a condition variable elsewhere.
+/// A waiter is off the list as soon as it is notified, so a burst of
+/// notifications costs one wakeup per waiter, not one per notification.
+///
+/// A waiter must check its condition between PrepareWait() and
+/// CommitWait(), and a notifier must make its change visible before
+/// Notify*():
+///
+///   event_count.PrepareWait();
+///   if (HasWork()) {
+///     event_count.CancelWait();
+///   } else {
+///     event_count.CommitWait();
+///   }
+///
+/// A thread waits on one EventCount at a time. Wakeups may be spurious,
+/// so callers re-check their condition.
+class EventCount {
+ public:
+  EventCount()
+      : waiters_(0),
+        head_(NULL),
+        tail_(NULL) {
+  }
+
+  void PrepareWait() {
+    Waiter* waiter = CurrentWaiter();
+    waiter->signaled.store(0, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      waiter->prev = tail_;
+      waiter->next = NULL;
+      if (tail_ != NULL) {
+        tail_->next = waiter;
+      } else {
+        head_ = waiter;
+      }
+      tail_ = waiter;
+      waiter->linked = true;
+      waiters_.fetch_add(1);
+    }
+    // Orders the registration before the caller's condition check.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void CancelWait() {
+    Waiter* waiter = CurrentWaiter();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (waiter->linked) {
+        Unlink(waiter);
+        return;
+      }
+    }
+
+    // A notifier picked this thread already; pass the wakeup on so that it
+    // is not lost to a thread which does not sleep.
+    NotifyOne();
+  }
+
+  void CommitWait() {
+    Waiter* waiter = CurrentWaiter();
+#if defined(__linux__)
+    while (waiter->signaled.load(std::memory_order_acquire) == 0) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&waiter->signaled), FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (waiter->signaled.load(std::memory_order_relaxed) == 0) {
+      cond_.wait(lock);
+    }
+#endif
+    // Signaled late by a notifier that took this thread off the list
+    // during an earlier, cancelled wait.
+    if (waiter->linked) {
+      Unlink(waiter);
+    }
+  }
+
+  void NotifyOne() {
+    Notify(1);
+  }
+
+  void NotifyAll() {
+    Notify(INT_MAX);
+  }
+
+  /// Wakes up to @count waiters, the longest waiting first.
+  void Notify(int count) {
+    // Orders the notifier's change, which may be a plain release store,
+    // before the check for waiters.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load() == 0) {
+      return;
+    }
+
+    // Wakes outside of the lock, a batch at a time.
+    const int kBatchSize = 16;
+    Waiter* woken[kBatchSize];
+    while (count > 0) {
+      int num_woken = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (; count > 0 && num_woken < kBatchSize && head_ != NULL; --count) {
+          woken[num_woken] = head_;
+          Unlink(head_);
+#if !defined(__linux__)
+          woken[num_woken]->signaled.store(1, std::memory_order_relaxed);
+#endif
+          ++num_woken;
+        }
+      }
+
+      if (num_woken == 0) {
+        break;
+      }
+
+#if defined(__linux__)
+      for (int i = 0; i < num_woken; ++i) {
+        woken[i]->signaled.store(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&woken[i]->signaled), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+      }
+#else
+      cond_.notify_all();
+#endif
+    }
+  }
+
+ private:
+  struct Waiter {
+    Waiter()
+        : signaled(0),
+          prev(NULL),
+          next(NULL),
+          linked(false) {
+    }
+
+    std::atomic<uint32_t> signaled;
+    // Guarded by the EventCount's mutex_.
+    Waiter* prev;
+    Waiter* next;
+    bool linked;
+  };
+
+  static Waiter* CurrentWaiter() {
+    static thread_local Waiter t_waiter;
+    return &t_waiter;
+  }
+
+  // mutex_ must be held.
+  void Unlink(Waiter* waiter) {
+    if (waiter->prev != NULL) {
+      waiter->prev->next = waiter->next;
+    } else {
+      head_ = waiter->next;
+    }
+
+    if (waiter->next != NULL) {
+      waiter->next->prev = waiter->prev;
+    } else {
+      tail_ = waiter->prev;
+    }
+
+    waiter->linked = false;
+    waiters_.fetch_sub(1);
+  }
+
+ private:
+  std::atomic<int> waiters_;
+
+  std::mutex mutex_;
+  Waiter* head_;
+  Waiter* tail_;
+
+#if !defined(__linux__)
+  std::condition_variable cond_;
+#endif
+
+  DISABLE_COPY_AND_ASSIGN(EventCount);
+};
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_EVENT_COUNT_H_
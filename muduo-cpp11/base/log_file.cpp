@@ -0,0 +1,309 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/base/log_file.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "muduo-cpp11/base/logging.h"
+
+using std::string;
+
+namespace muduo_cpp11 {
+
+namespace {
+
+void ReportError(const char* what, const string& path) {
+  int saved_errno = errno;
+  fprintf(stderr,
+          "LogFile: %s \"%s\" fail, errno: %d, error info: %s\n",
+          what,
+          path.c_str(),
+          saved_errno,
+          strerror_tl(saved_errno).c_str());
+}
+
+}  // namespace
+
+LogFile::LogFile(const string& basename,
+                 const size_t roll_size,
+                 const int roll_interval)
+    : basename_(basename),
+      next_path_(basename + ".next." + std::to_string(getpid())),
+      roll_size_(roll_size),
+      roll_interval_(roll_interval > 0 ? roll_interval : 24 * 60 * 60),
+      preallocate_size_(roll_size),
+      sync_interval_(0),
+      max_files_(0),
+      fd_(-1),
+      written_bytes_(0),
+      period_(0),
+      last_sync_(0),
+      roll_count_(0),
+      next_fd_(-1),
+      running_(false) {
+}
+
+LogFile::~LogFile() {
+  Stop();
+}
+
+bool LogFile::Start() {
+  assert(!running_);
+  if (running_) {
+    return true;
+  }
+
+  time_t now = ::time(NULL);
+  fd_ = OpenFile(FileName(now));
+  if (fd_ < 0) {
+    return false;
+  }
+
+  struct tm tm;
+  localtime_r(&now, &tm);
+  period_ = (now + tm.tm_gmtoff) / roll_interval_;
+  last_sync_ = now;
+
+  running_ = true;
+  thread_.reset(new std::thread(std::bind(&LogFile::ThreadFunc, this)));
+  tasks_.Put(std::bind(&LogFile::PrepareNextFile, this));
+  tasks_.Put(std::bind(&LogFile::RemoveOldFiles, this));
+  return true;
+}
+
+void LogFile::Stop() {
+  if (!running_) {
+    return;
+  }
+
+  tasks_.Put(std::bind(&LogFile::RetireFile, this, fd_));
+  tasks_.Put(Task());
+  thread_->join();
+  thread_.reset();
+  fd_ = -1;
+  running_ = false;
+
+  if (next_fd_ >= 0) {
+    close(next_fd_);
+    unlink(next_path_.c_str());
+    next_fd_ = -1;
+  }
+}
+
+void LogFile::Append(const char* data, size_t len) {
+  assert(running_);
+  time_t now = ::time(NULL);
+
+  struct tm tm;
+  localtime_r(&now, &tm);
+  time_t period = (now + tm.tm_gmtoff) / roll_interval_;
+  if (period != period_ || (written_bytes_ > 0 && written_bytes_ + len > roll_size_)) {
+    period_ = period;
+    Roll(now);
+  }
+
+  while (len > 0) {
+    ssize_t n = write(fd_, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      ReportError("write", basename_);
+      return;
+    }
+
+    data += n;
+    len -= n;
+    written_bytes_ += n;
+  }
+
+  if (sync_interval_ > 0 && now - last_sync_ >= sync_interval_) {
+    last_sync_ = now;
+    tasks_.Put(std::bind(&LogFile::SyncFile, this, fd_));
+  }
+}
+
+string LogFile::FileName(const time_t now) const {
+  char timebuf[32];
+  struct tm tm;
+  localtime_r(&now, &tm);
+  strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm);
+
+  // The sequence number keeps several rolls within one second apart.
+  char seqbuf[32];
+  snprintf(seqbuf, sizeof seqbuf, ".%04d.log", roll_count_);
+  return basename_ + timebuf + std::to_string(getpid()) + seqbuf;
+}
+
+int LogFile::OpenFile(const string& path) const {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    ReportError("open", path);
+    return -1;
+  }
+
+#if defined(__linux__) && !defined(__ANDROID_API__)
+  // Reserve the blocks up front without changing the file size, so the
+  // file system does not allocate on every append.
+  if (preallocate_size_ > 0 &&
+      fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate_size_)) != 0 &&
+      errno != EOPNOTSUPP) {
+    ReportError("fallocate", path);
+  }
+#endif
+
+  return fd;
+}
+
+void LogFile::Roll(const time_t now) {
+  ++roll_count_;
+  string path = FileName(now);
+
+  int fd = -1;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(fd, next_fd_);
+  }
+
+  if (fd >= 0) {
+    tasks_.Put(std::bind(&LogFile::RenameFile, this, next_path_, path));
+  } else {
+    // The helper thread has not caught up, e.g. two rolls in a row.
+    fd = OpenFile(path);
+    if (fd < 0) {
+      // Keep writing to the old file rather than losing logs.
+      return;
+    }
+  }
+
+  tasks_.Put(std::bind(&LogFile::RetireFile, this, fd_));
+  tasks_.Put(std::bind(&LogFile::PrepareNextFile, this));
+  if (max_files_ > 0) {
+    tasks_.Put(std::bind(&LogFile::RemoveOldFiles, this));
+  }
+
+  fd_ = fd;
+  written_bytes_ = 0;
+}
+
+void LogFile::PrepareNextFile() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (next_fd_ >= 0) {
+      return;
+    }
+  }
+
+  // A leftover from a crashed run would otherwise be appended to.
+  unlink(next_path_.c_str());
+  int fd = OpenFile(next_path_);
+  if (fd < 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  next_fd_ = fd;
+}
+
+void LogFile::RetireFile(const int fd) {
+  if (fd < 0) {
+    return;
+  }
+
+  // Give back the preallocated blocks that were not used.
+  struct stat st;
+  if (fstat(fd, &st) == 0 && ftruncate(fd, st.st_size) != 0) {
+    ReportError("ftruncate", basename_);
+  }
+
+  if (sync_interval_ > 0) {
+    SyncFile(fd);
+  }
+
+  close(fd);
+}
+
+void LogFile::RenameFile(const string& from, const string& to) {
+  if (rename(from.c_str(), to.c_str()) != 0) {
+    ReportError("rename", from);
+  }
+}
+
+void LogFile::SyncFile(const int fd) {
+#if defined(__MACH__)
+  if (fsync(fd) != 0) {
+#else
+  if (fdatasync(fd) != 0) {
+#endif
+    ReportError("fdatasync", basename_);
+  }
+}
+
+void LogFile::RemoveOldFiles() {
+  if (max_files_ <= 0) {
+    return;
+  }
+
+  string dir(".");
+  string prefix(basename_);
+  string::size_type slash = basename_.rfind('/');
+  if (slash != string::npos) {
+    dir = basename_.substr(0, slash + 1);
+    prefix = basename_.substr(slash + 1);
+  }
+  prefix += ".";
+
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL) {
+    ReportError("opendir", dir);
+    return;
+  }
+
+  // Names start with the roll time, so sorting them sorts by age.
+  std::vector<string> files;
+  const string suffix(".log");
+  struct dirent* entry = NULL;
+  while ((entry = readdir(d)) != NULL) {
+    string name(entry->d_name);
+    if (name.size() > prefix.size() + suffix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      files.push_back(name);
+    }
+  }
+  closedir(d);
+
+  std::sort(files.begin(), files.end());
+  for (size_t i = 0; i + max_files_ < files.size(); ++i) {
+    string path = (slash != string::npos ? dir : string()) + files[i];
+    if (unlink(path.c_str()) != 0) {
+      ReportError("unlink", path);
+    }
+  }
+}
+
+void LogFile::ThreadFunc() {
+  for (;;) {
+    Task task(tasks_.Take());
+    if (!task) {
+      break;
+    }
+    task();
+  }
+}
+
+}  // namespace muduo_cpp11
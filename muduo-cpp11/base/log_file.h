@@ -0,0 +1,118 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_LOG_FILE_H_
+#define MUDUO_CPP11_BASE_LOG_FILE_H_
+
+#include <stddef.h>
+#include <time.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "muduo-cpp11/base/blocking_queue.h"
+#include "muduo-cpp11/base/macros.h"
+
+namespace muduo_cpp11 {
+
+/// Rolling log file, written by a single thread, e.g. AsyncLogging's
+/// writer:
+///
+///   LogFile file("/var/log/server", 512 * 1024 * 1024);
+///   file.Start();
+///   async_logging.set_output_callback(
+///       std::bind(&LogFile::Append, &file, std::placeholders::_1, std::placeholders::_2));
+///
+/// A new file <basename>.<YYYYmmdd-HHMMSS>.<pid>.<seq>.log is started
+/// when the current one would exceed roll_size bytes or a new roll_interval
+/// period (in local time, daily by default) begins.
+///
+/// The next file is opened and preallocated ahead of time by a helper
+/// thread, so rolling only swaps file descriptors in the writer. Renaming
+/// the new file, releasing unused preallocation and closing the old one,
+/// fdatasync and retention cleanup all run on the helper thread too.
+class LogFile {
+ public:
+  LogFile(const std::string& basename,
+          const size_t roll_size,
+          const int roll_interval = 24 * 60 * 60);
+  ~LogFile();
+
+  // Must be called before Start().
+  // Bytes reserved with fallocate() for each file, roll_size by default,
+  // 0 to disable. Only on Linux.
+  void set_preallocate_size(const size_t size) {
+    preallocate_size_ = size;
+  }
+
+  // fdatasync() the file at most once every @seconds, 0 (default) leaves
+  // it to the OS.
+  void set_sync_interval(const int seconds) {
+    sync_interval_ = seconds;
+  }
+
+  // Keeps the newest @max_files files, 0 (default) keeps all.
+  void set_max_files(const int max_files) {
+    max_files_ = max_files;
+  }
+
+  bool Start();
+  void Stop();
+
+  /// Not thread safe, only one thread may append.
+  void Append(const char* data, size_t len);
+
+  int roll_count() const {
+    return roll_count_;
+  }
+
+ private:
+  typedef std::function<void ()> Task;
+
+  std::string FileName(const time_t now) const;
+  int OpenFile(const std::string& path) const;
+  void Roll(const time_t now);
+
+  // Run in the helper thread.
+  void PrepareNextFile();
+  void RetireFile(const int fd);
+  void RenameFile(const std::string& from, const std::string& to);
+  void SyncFile(const int fd);
+  void RemoveOldFiles();
+  void ThreadFunc();
+
+ private:
+  const std::string basename_;
+  const std::string next_path_;
+  const size_t roll_size_;
+  const int roll_interval_;
+  size_t preallocate_size_;
+  int sync_interval_;
+  int max_files_;
+
+  // Writer thread only.
+  int fd_;
+  size_t written_bytes_;
+  time_t period_;
+  time_t last_sync_;
+  int roll_count_;
+
+  // The prepared next file, -1 while the helper thread is still on it.
+  std::mutex mutex_;
+  int next_fd_;
+
+  bool running_;
+  std::unique_ptr<std::thread> thread_;
+  BlockingQueue<Task> tasks_;
+
+  DISABLE_COPY_AND_ASSIGN(LogFile);
+};
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_LOG_FILE_H_
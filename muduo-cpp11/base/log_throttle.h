@@ -0,0 +1,135 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_LOG_THROTTLE_H_
+#define MUDUO_CPP11_BASE_LOG_THROTTLE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <ostream>
+
+#include "muduo-cpp11/base/logging.h"
+
+namespace muduo_cpp11 {
+
+struct LogThrottleResult {
+  LogThrottleResult()
+      : should_log(false),
+        suppressed(0) {
+  }
+
+  bool should_log;
+  // Occurrences not logged since the last logged one.
+  uint64_t suppressed;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LogThrottleResult& result) {
+  if (result.suppressed > 0) {
+    os << "[" << result.suppressed << " similar messages suppressed] ";
+  }
+  return os;
+}
+
+/// Lets at most N occurrences per second through, per call site.
+/// Lock free, a few relaxed atomics per call; the count may be off by a
+/// few around a second boundary, which is fine for logging.
+class LogRateLimiter {
+ public:
+  constexpr LogRateLimiter()
+      : second_(0),
+        count_(0),
+        suppressed_(0) {
+  }
+
+  LogThrottleResult Check(const int max_per_second) {
+    LogThrottleResult result;
+    int64_t now = static_cast<int64_t>(::time(NULL));
+    int64_t second = second_.load(std::memory_order_relaxed);
+    if (second != now && second_.compare_exchange_strong(second, now, std::memory_order_relaxed)) {
+      count_.store(0, std::memory_order_relaxed);
+    }
+
+    if (count_.fetch_add(1, std::memory_order_relaxed) < max_per_second) {
+      result.should_log = true;
+      result.suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    } else {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+ private:
+  std::atomic<int64_t> second_;
+  std::atomic<int> count_;
+  std::atomic<uint64_t> suppressed_;
+};
+
+/// Lets the 1st, (N+1)th, (2N+1)th... occurrence through, per call site.
+class LogSampler {
+ public:
+  constexpr LogSampler()
+      : count_(0) {
+  }
+
+  LogThrottleResult Check(const int n) {
+    LogThrottleResult result;
+    uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+    if (n <= 1 || count % n == 0) {
+      result.should_log = true;
+      result.suppressed = (count == 0 || n <= 1) ? 0 : n - 1;
+    }
+    return result;
+  }
+
+ private:
+  std::atomic<uint64_t> count_;
+};
+
+}  // namespace muduo_cpp11
+
+// Each expansion gets its own static limiter through the lambda. The for
+// loop runs the log statement at most once and keeps the macro a single
+// statement, so it is safe in an unbraced if/else.
+#define MUDUO_LOG_THROTTLE(throttle_type, limit) \
+  for (::muduo_cpp11::LogThrottleResult muduo_log_throttle = \
+           []() -> ::muduo_cpp11::throttle_type& { \
+             static ::muduo_cpp11::throttle_type throttle; \
+             return throttle; \
+           }().Check(limit); \
+       muduo_log_throttle.should_log; \
+       muduo_log_throttle.should_log = false)
+
+#if defined(__MACH__) || defined(__ANDROID_API__)
+// LogRateLimited(LogError, 10, "accept failed, errno %d", errno);
+// LogSampled(LogWarn, 100, "POLLHUP on fd %d", fd);
+#define MUDUO_LOG_THROTTLED(throttle_type, log_macro, limit, format, ...) \
+  MUDUO_LOG_THROTTLE(throttle_type, limit) do { \
+    if (muduo_log_throttle.suppressed == 0) { \
+      log_macro(format, ##__VA_ARGS__); \
+    } else { \
+      log_macro("[%llu similar messages suppressed] " format, \
+                static_cast<unsigned long long>(muduo_log_throttle.suppressed), \
+                ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define LogRateLimited(log_macro, max_per_second, format, ...) \
+  MUDUO_LOG_THROTTLED(LogRateLimiter, log_macro, max_per_second, format, ##__VA_ARGS__)
+
+#define LogSampled(log_macro, n, format, ...) \
+  MUDUO_LOG_THROTTLED(LogSampler, log_macro, n, format, ##__VA_ARGS__)
+#else
+// LOG_RATE_LIMITED(ERROR, 10) << "accept failed";
+// LOG_SAMPLED(WARNING, 100) << "POLLHUP on fd " << fd;
+#define LOG_RATE_LIMITED(severity, max_per_second) \
+  MUDUO_LOG_THROTTLE(LogRateLimiter, max_per_second) LOG(severity) << muduo_log_throttle
+
+#define LOG_SAMPLED(severity, n) \
+  MUDUO_LOG_THROTTLE(LogSampler, n) LOG(severity) << muduo_log_throttle
+#endif
+
+#endif  // MUDUO_CPP11_BASE_LOG_THROTTLE_H_
@@ -18,6 +18,8 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <fcntl.h>
+
+#include <algorithm>
 #endif
 
 #if defined(__ANDROID_API__)
@@ -60,8 +62,70 @@ namespace {
 const int kLogLineMaxSize = 1024;
 const int kLogBuffSize = 64 * 1024;
 
+// "[2014-01-01 00:00:00:"
+const int kTimePrefixSize = 21;
+
+char* AppendString(char* dest, const char* end, const char* src) {
+  while (*src != '\0' && dest < end) {
+    *dest++ = *src++;
+  }
+  return dest;
+}
+
+char* AppendInt(char* dest, const char* end, int value) {
+  char digits[16];
+  char* p = digits;
+  unsigned int v = value < 0 ? 0U - static_cast<unsigned int>(value) : value;
+  do {
+    *p++ = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+
+  if (value < 0 && dest < end) {
+    *dest++ = '-';
+  }
+
+  while (p != digits && dest < end) {
+    *dest++ = *--p;
+  }
+  return dest;
+}
+
 }  // namespace
 
+struct Logger::StagingBuffer {
+  StagingBuffer()
+      : len(0),
+        cached_second(-1) {
+    tid_prefix_len = snprintf(tid_prefix, sizeof tid_prefix, "] [tid=%d] [", gettid());
+  }
+
+  std::mutex mutex;
+  int len;
+  char data[kLogBuffSize];
+
+  // Only changes once a second, so it is formatted once per second per
+  // thread instead of calling localtime_r() for every line.
+  time_t cached_second;
+  char time_prefix[kTimePrefixSize + 1];
+
+  int tid_prefix_len;
+  char tid_prefix[32];
+};
+
+// Writes out what the thread staged when it exits.
+struct Logger::StagingBufferHolder {
+  ~StagingBufferHolder() {
+    if (staging) {
+      std::lock_guard<std::mutex> lock(staging->mutex);
+      logger->Fsync(staging.get(), false);
+    }
+  }
+
+  Logger* logger;
+  std::shared_ptr<StagingBuffer> staging;
+};
+
 Logger::LogLevel g_log_level = Logger::kInfo;
 
 void Logger::set_log_level(const Logger::LogLevel level) {
@@ -81,22 +145,25 @@ Logger& Logger::GetInstance() {
 Logger::Logger()
     : log_fd_(STDERR_FILENO),
       log_cached_(false) {
-  log_buf_.resize(kLogBuffSize);
-  current_buf_pos_ = &log_buf_[0];
 }
 
 Logger::~Logger() {
-  if (log_fd_ > 0) {
-    // Write buffer logs to file before exiting.
-    if (current_buf_pos_ - &log_buf_[0]) {
-      Fsync(true);
-      current_buf_pos_ = &log_buf_[0];
+  // Write buffer logs to file before exiting.
+  {
+    std::lock_guard<std::mutex> lock(log_mutex_);
+    for (size_t i = 0; i < staging_buffers_.size(); ++i) {
+      std::lock_guard<std::mutex> staging_lock(staging_buffers_[i]->mutex);
+      Fsync(staging_buffers_[i].get(), i + 1 == staging_buffers_.size());
     }
+  }
 
-    if (log_fd_ != STDERR_FILENO) {
-      close(log_fd_);
-      log_fd_ = STDERR_FILENO;
-    }
+  for (size_t i = 0; i < retired_fds_.size(); ++i) {
+    close(retired_fds_[i]);
+  }
+
+  if (log_fd_ != STDERR_FILENO) {
+    close(log_fd_);
+    log_fd_ = STDERR_FILENO;
   }
 }
 
@@ -118,17 +185,42 @@ bool Logger::set_log_file_path(const std::string& path) {
       return false;
     }
 
-    if (log_fd_ != STDERR_FILENO) {
-      close(log_fd_);
+    int old_fd = log_fd_.exchange(log_fd);
+    if (old_fd != STDERR_FILENO) {
+      retired_fds_.push_back(old_fd);
     }
 
-    log_fd_ = log_fd;
     log_file_path_ = path;
   }
 
   return true;
 }
 
+Logger::StagingBuffer* Logger::GetStagingBuffer() {
+  static thread_local StagingBufferHolder t_holder;
+
+  if (!t_holder.staging) {
+    t_holder.logger = this;
+    t_holder.staging = std::make_shared<StagingBuffer>();
+
+    std::lock_guard<std::mutex> lock(log_mutex_);
+
+    // Forget the buffers of threads that have exited, they flushed on exit.
+    for (size_t i = 0; i < staging_buffers_.size();) {
+      if (staging_buffers_[i].use_count() == 1) {
+        staging_buffers_[i] = staging_buffers_.back();
+        staging_buffers_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+
+    staging_buffers_.push_back(t_holder.staging);
+  }
+
+  return t_holder.staging.get();
+}
+
 void Logger::Log(const int priority,
                  const char* caption,
                  const bool need_sync,
@@ -141,92 +233,117 @@ void Logger::Log(const int priority,
     return;
   }
 
-  va_list ap;
-  va_start(ap, format);
-  char text[kLogLineMaxSize];
-  int text_len = vsnprintf(text, sizeof(text), format, ap);
-  va_end(ap);
-
-  // Log text is too long!
-  if ((text_len + 128) > kLogLineMaxSize) {
-    fprintf(stderr,
-            "file: " __FILE__ ", line: %d, log buff size: %d < log text length: %d ",
-            __LINE__,
-            kLogLineMaxSize,
-            text_len + 128);
-    return;
-  }
-
   struct timeval tv;
   gettimeofday(&tv, NULL);
-  struct tm local_tm;
-  struct tm* tm = localtime_r(&tv.tv_sec, &local_tm);
-  int64_t milliseconds = tv.tv_usec / 1000;
 
+  // If file_name has prefix, just remove it.
+  const char* p = NULL;
+  if ((p = strrchr(file_name, '/')) != NULL) {
+    p++;
+  } else {
+    p = file_name;
+  }
+
+  StagingBuffer* staging = GetStagingBuffer();
   {
-    std::lock_guard<std::mutex> lock(log_mutex_);
+    // Only contended by ForceSync(), threads never wait for each other here.
+    std::lock_guard<std::mutex> lock(staging->mutex);
 
-    // Left space in buffer is not enough, write buffer logs to file.
-    if (((current_buf_pos_ - &log_buf_[0]) + text_len + 128) > kLogLineMaxSize) {
-      Fsync(false);
+    // Left space in buffer is not enough for one more line, write buffer
+    // logs to file.
+    if (staging->len + kLogLineMaxSize > kLogBuffSize) {
+      Fsync(staging, false);
     }
 
-    // If file_name has prefix, just remove it.
-    const char* p = NULL;
-    if ((p = strrchr(file_name, '/')) != NULL) {
-      p++;
-    } else {
-      p = file_name;
+    if (tv.tv_sec != staging->cached_second) {
+      struct tm local_tm;
+      time_t seconds = tv.tv_sec;
+      localtime_r(&seconds, &local_tm);
+      snprintf(staging->time_prefix,
+               sizeof staging->time_prefix,
+               "[%04d-%02d-%02d %02d:%02d:%02d:",
+               local_tm.tm_year + 1900,
+               local_tm.tm_mon + 1,
+               local_tm.tm_mday,
+               local_tm.tm_hour,
+               local_tm.tm_min,
+               local_tm.tm_sec);
+      staging->cached_second = tv.tv_sec;
     }
 
-    int buff_len = sprintf(current_buf_pos_,
-                           "[%04d-%02d-%02d %02d:%02d:%02d:%03" PRId64 "] [tid=%d] [%s::%s:%d] %s - ",
-                           tm->tm_year + 1900,
-                           tm->tm_mon + 1,
-                           tm->tm_mday,
-                           tm->tm_hour,
-                           tm->tm_min,
-                           tm->tm_sec,
-                           milliseconds,
-                           gettid(),
-                           p,
-                           func_name,
-                           line_number,
-                           caption);
-
-    current_buf_pos_ += buff_len;
-    memcpy(current_buf_pos_, text, text_len);
-    current_buf_pos_ += text_len;
-    *current_buf_pos_++ = '\n';
+    // "[%04d-%02d-%02d %02d:%02d:%02d:%03d] [tid=%d] [%s::%s:%d] %s - "
+    char* line = staging->data + staging->len;
+    // Keep one byte for '\n'.
+    char* end = line + kLogLineMaxSize - 1;
+    char* pos = line;
+
+    memcpy(pos, staging->time_prefix, kTimePrefixSize);
+    pos += kTimePrefixSize;
+    int milliseconds = static_cast<int>(tv.tv_usec / 1000);
+    *pos++ = static_cast<char>('0' + milliseconds / 100);
+    *pos++ = static_cast<char>('0' + milliseconds / 10 % 10);
+    *pos++ = static_cast<char>('0' + milliseconds % 10);
+    memcpy(pos, staging->tid_prefix, staging->tid_prefix_len);
+    pos += staging->tid_prefix_len;
+    pos = AppendString(pos, end, p);
+    pos = AppendString(pos, end, "::");
+    pos = AppendString(pos, end, func_name);
+    pos = AppendString(pos, end, ":");
+    pos = AppendInt(pos, end, line_number);
+    pos = AppendString(pos, end, "] ");
+    pos = AppendString(pos, end, caption);
+    pos = AppendString(pos, end, " - ");
+
+    // Format the text in place; a line too long is truncated.
+    va_list ap;
+    va_start(ap, format);
+    int text_len = vsnprintf(pos, end - pos + 1, format, ap);
+    va_end(ap);
+    if (text_len > 0) {
+      pos += std::min<int>(text_len, end - pos);
+    }
+    *pos++ = '\n';
+
+    int line_len = static_cast<int>(pos - line);
+    staging->len += line_len;
 
 #if defined(__ANDROID_API__)
     // For android debug.
-    {
-      string android_log(&log_buf_[0], current_buf_pos_ - &log_buf_[0]);
-      __android_log_print(ANDROID_LOG_DEBUG, "HDData", "%s", android_log.c_str());
-    }
+    __android_log_print(ANDROID_LOG_DEBUG, "HDData", "%.*s", line_len, line);
 #endif
 
     if (!log_cached_ || need_sync) {
-      Fsync(false);
+      Fsync(staging, false);
     }
   }
 
   if (priority == Logger::kFatal) {
+    ForceSync();
     abort();
   }
 }
 
 void Logger::ForceSync() {
-  std::lock_guard<std::mutex> lock(log_mutex_);
-  Fsync(false);
+  std::vector<std::shared_ptr<StagingBuffer>> staging_buffers;
+  {
+    std::lock_guard<std::mutex> lock(log_mutex_);
+    staging_buffers = staging_buffers_;
+  }
+
+  for (size_t i = 0; i < staging_buffers.size(); ++i) {
+    std::lock_guard<std::mutex> lock(staging_buffers[i]->mutex);
+    Fsync(staging_buffers[i].get(), false);
+  }
 }
 
-void Logger::Fsync(const bool flush) {
+void Logger::Fsync(StagingBuffer* staging, const bool flush) {
   int result = 0;
-  int write_bytes = current_buf_pos_ - &log_buf_[0];
+  int write_bytes = staging->len;
+  int log_fd = log_fd_;
 
-  if (write(log_fd_, &log_buf_[0], write_bytes) != write_bytes) {
+  // A single write() per batch, O_APPEND keeps the batches of different
+  // threads from overwriting each other.
+  if (write_bytes > 0 && write(log_fd, staging->data, write_bytes) != write_bytes) {
       result = (errno != 0) ? errno : EIO;
       fprintf(stderr,
               "file: " __FILE__ ", line: %d, call write fail, errno: %d, error info: %s\n",
@@ -235,16 +352,16 @@ void Logger::Fsync(const bool flush) {
               strerror_tl(result).c_str());
   }
 
-  current_buf_pos_ = &log_buf_[0];
+  staging->len = 0;
 
-  if (flush && log_fd_ != STDERR_FILENO) {
+  if (flush && log_fd != STDERR_FILENO) {
     // The OS will buffer writes to make best use of the limited amount of disk
     // IO available. Writes will typically be flushed within five to thirty
     // seconds; sooner if the programmer (or libraries) calls fdatasync(2) or
     // fsync(2) or sync(2) (which asks for all dirty data to be flushed). Any
     // data in the OS buffers are written to disk (eventually) when the program
     // crashes, lost if the kernel crashes.
-    if (fsync(log_fd_) != 0) {
+    if (fsync(log_fd) != 0) {
       result = (errno != 0) ? errno : EIO;
       fprintf(stderr,
               "file: " __FILE__ ", line: %d, call fsync fail, errno: %d, error info: %s\n",
@@ -6,6 +6,7 @@
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
 #include <glog/logging.h>
 #else
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -63,12 +64,19 @@ class Logger {
            const char* format,
            ...);
 
+  // Writes out the lines staged by every thread.
   void ForceSync();
 
  private:
+  struct StagingBuffer;
+  struct StagingBufferHolder;
+
   Logger();
 
-  void Fsync(const bool need_flush);
+  StagingBuffer* GetStagingBuffer();
+
+  // Writes out the lines staged by one thread, its lock must be held.
+  void Fsync(StagingBuffer* staging, const bool need_flush);
 
   // TODO(yifan.fan): ouput func can be set, so we can write log to disk or remote server.
   // void OutputFunc(const char* msg, int len);
@@ -77,13 +85,15 @@ class Logger {
   static std::unique_ptr<Logger> instance_;
   static std::once_flag once_flag_;
 
-  int log_fd_;
+  // Threads write their staged lines without taking log_mutex_, so a
+  // replaced fd is kept open until the Logger goes away.
+  std::atomic<int> log_fd_;
   bool log_cached_;
   std::string log_file_path_;
 
   std::mutex log_mutex_;
-  std::vector<char> log_buf_;
-  char *current_buf_pos_;
+  std::vector<int> retired_fds_;
+  std::vector<std::shared_ptr<StagingBuffer>> staging_buffers_;
 
   DISABLE_COPY_AND_ASSIGN(Logger);
 };
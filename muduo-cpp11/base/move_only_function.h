@@ -0,0 +1,203 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_MOVE_ONLY_FUNCTION_H_
+#define MUDUO_CPP11_BASE_MOVE_ONLY_FUNCTION_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace muduo_cpp11 {
+
+template <typename Signature>
+class MoveOnlyFunction;
+
+/// Like std::function, but only needs the callable to be movable, so it
+/// can hold lambdas capturing a std::unique_ptr, a std::packaged_task...
+/// It is itself move only.
+///
+/// Callables of up to kInlineSize bytes (56 on 64-bit), e.g. a std::bind()
+/// of a member function, a shared_ptr and a std::string, are stored
+/// inline, so the object fills one cache line and passing callbacks
+/// around does not go to malloc.
+template <typename R, typename... Args>
+class MoveOnlyFunction<R (Args...)> {
+ public:
+  static const size_t kInlineSize = 7 * sizeof(void*);
+
+  MoveOnlyFunction()
+      : ops_(NULL) {
+  }
+
+  MoveOnlyFunction(std::nullptr_t)
+      : ops_(NULL) {
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, MoveOnlyFunction>::value>::type>
+  MoveOnlyFunction(F&& f)
+      : ops_(NULL) {
+    typedef typename std::decay<F>::type Functor;
+    if (!IsNull(f)) {
+      Store<Functor>(std::forward<F>(f), std::integral_constant<bool, IsInline<Functor>::value>());
+    }
+  }
+
+  MoveOnlyFunction(MoveOnlyFunction&& other)
+      : ops_(other.ops_) {
+    if (ops_ != NULL) {
+      ops_->move(&storage_, &other.storage_);
+      other.ops_ = NULL;
+    }
+  }
+
+  ~MoveOnlyFunction() {
+    Reset();
+  }
+
+  MoveOnlyFunction& operator=(MoveOnlyFunction&& other) {
+    if (this != &other) {
+      Reset();
+      if (other.ops_ != NULL) {
+        other.ops_->move(&storage_, &other.storage_);
+        ops_ = other.ops_;
+        other.ops_ = NULL;
+      }
+    }
+    return *this;
+  }
+
+  MoveOnlyFunction& operator=(std::nullptr_t) {
+    Reset();
+    return *this;
+  }
+
+  R operator()(Args... args) const {
+    return ops_->invoke(const_cast<Storage*>(&storage_), std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const {
+    return ops_ != NULL;
+  }
+
+ private:
+  typedef typename std::aligned_storage<kInlineSize, alignof(void*)>::type Storage;
+
+  // A hand-rolled vtable, one static instance per stored type.
+  struct Ops {
+    R (*invoke)(Storage* storage, Args&&... args);
+    // Move constructs into @to and destroys @from.
+    void (*move)(Storage* to, Storage* from);
+    void (*destroy)(Storage* storage);
+  };
+
+  // Moving an inline callable must not throw, the move constructor and
+  // assignment of MoveOnlyFunction do not.
+  template <typename F>
+  struct IsInline {
+    static const bool value = sizeof(F) <= sizeof(Storage) &&
+                              alignof(F) <= alignof(Storage) &&
+                              std::is_nothrow_move_constructible<F>::value;
+  };
+
+  template <typename F>
+  struct InlineOps {
+    static F* Get(Storage* storage) {
+      return reinterpret_cast<F*>(storage);
+    }
+
+    static R Invoke(Storage* storage, Args&&... args) {
+      return (*Get(storage))(std::forward<Args>(args)...);
+    }
+
+    static void Move(Storage* to, Storage* from) {
+      new (to) F(std::move(*Get(from)));
+      Get(from)->~F();
+    }
+
+    static void Destroy(Storage* storage) {
+      Get(storage)->~F();
+    }
+
+    static const Ops* Instance() {
+      static const Ops ops = { &Invoke, &Move, &Destroy };
+      return &ops;
+    }
+  };
+
+  template <typename F>
+  struct HeapOps {
+    static F*& Get(Storage* storage) {
+      return *reinterpret_cast<F**>(storage);
+    }
+
+    static R Invoke(Storage* storage, Args&&... args) {
+      return (*Get(storage))(std::forward<Args>(args)...);
+    }
+
+    static void Move(Storage* to, Storage* from) {
+      new (to) F*(Get(from));
+    }
+
+    static void Destroy(Storage* storage) {
+      delete Get(storage);
+    }
+
+    static const Ops* Instance() {
+      static const Ops ops = { &Invoke, &Move, &Destroy };
+      return &ops;
+    }
+  };
+
+  template <typename F, typename U>
+  void Store(U&& f, std::true_type /* inline */) {
+    new (&storage_) F(std::forward<U>(f));
+    ops_ = InlineOps<F>::Instance();
+  }
+
+  template <typename F, typename U>
+  void Store(U&& f, std::false_type /* inline */) {
+    new (&storage_) F*(new F(std::forward<U>(f)));
+    ops_ = HeapOps<F>::Instance();
+  }
+
+  void Reset() {
+    if (ops_ != NULL) {
+      ops_->destroy(&storage_);
+      ops_ = NULL;
+    }
+  }
+
+  template <typename F>
+  static bool IsNull(const F&) {
+    return false;
+  }
+
+  template <typename T>
+  static bool IsNull(T* p) {
+    return p == nullptr;
+  }
+
+  template <typename Sig>
+  static bool IsNull(const std::function<Sig>& f) {
+    return !f;
+  }
+
+ private:
+  Storage storage_;
+  const Ops* ops_;
+};
+
+template <typename R, typename... Args>
+const size_t MoveOnlyFunction<R (Args...)>::kInlineSize;
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_MOVE_ONLY_FUNCTION_H_
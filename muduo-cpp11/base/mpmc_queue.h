@@ -0,0 +1,255 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_MPMC_QUEUE_H_
+#define MUDUO_CPP11_BASE_MPMC_QUEUE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "muduo-cpp11/base/event_count.h"
+#include "muduo-cpp11/base/macros.h"
+
+namespace muduo_cpp11 {
+
+/// Bounded multi-producer multi-consumer queue, lock free on the fast
+/// path (Dmitry Vyukov's ring of sequence-numbered slots). Each slot's
+/// sequence tells whether it is ready to be written or read for the
+/// current lap, so producers and consumers only contend on one CAS each.
+///
+/// TryPut()/TryTake() never block. Put()/Take() spin for a short while
+/// and then park on an EventCount until the other side makes progress.
+/// Notifying costs a fence and an atomic load while nobody is parked.
+template <typename T>
+class MpmcQueue {
+ public:
+  /// @capacity is rounded up to a power of 2.
+  explicit MpmcQueue(const size_t capacity)
+      : mask_(RoundUp(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MpmcQueue() {
+    T value;
+    while (TryTake(&value)) {
+    }
+  }
+
+  /// On failure @value is not moved from.
+  bool TryPut(T&& value) {
+    return TryEmplace(std::move(value));
+  }
+
+  bool TryPut(const T& value) {
+    return TryEmplace(value);
+  }
+
+  bool TryTake(T* value) {
+    Cell* cell = NULL;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    T* stored = cell->value();
+    *value = std::move(*stored);
+    stored->~T();
+    // Ready for the producer of the next lap.
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    not_full_.NotifyOne();
+    return true;
+  }
+
+  void Put(T&& value) {
+    PutWait(std::move(value));
+  }
+
+  void Put(const T& value) {
+    T copy(value);
+    PutWait(std::move(copy));
+  }
+
+  T Take() {
+    T value;
+    for (int i = 0; !TryTake(&value); ++i) {
+      if (i < kSpinCount) {
+        Pause();
+        continue;
+      }
+
+      not_empty_.PrepareWait();
+      if (TryTake(&value)) {
+        not_empty_.CancelWait();
+        break;
+      }
+      not_empty_.CommitWait();
+    }
+    return value;
+  }
+
+  /// Puts all of @values in order, waiting for room when the queue is
+  /// full; consumers are woken once per run of successful puts.
+  void PutMany(std::vector<T> values) {
+    size_t i = 0;
+    while (i < values.size()) {
+      size_t begin = i;
+      while (i < values.size() && TryEmplace(std::move(values[i]), false)) {
+        ++i;
+      }
+
+      if (i > begin) {
+        not_empty_.Notify(static_cast<int>(i - begin));
+      }
+
+      if (i < values.size()) {
+        PutWait(std::move(values[i]));
+        ++i;
+      }
+    }
+  }
+
+  /// Waits until the queue is not empty, then moves everything in it, up
+  /// to @max_values, to the end of @values. Returns the number taken.
+  size_t TakeAll(std::vector<T>* values, const size_t max_values = SIZE_MAX) {
+    values->push_back(Take());
+    size_t count = 1;
+
+    T value;
+    while (count < max_values && TryTake(&value)) {
+      values->push_back(std::move(value));
+      ++count;
+    }
+    return count;
+  }
+
+  /// A snapshot, may be stale by the time it returns.
+  size_t Size() const {
+    size_t dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  static const int kSpinCount = 128;
+
+  struct Cell {
+    T* value() {
+      return reinterpret_cast<T*>(&storage);
+    }
+
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  static size_t RoundUp(const size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  template <typename U>
+  bool TryEmplace(U&& value, const bool notify = true) {
+    Cell* cell = NULL;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    new (cell->value()) T(std::forward<U>(value));
+    // Ready for the consumer of this lap.
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    if (notify) {
+      not_empty_.NotifyOne();
+    }
+    return true;
+  }
+
+  void PutWait(T&& value) {
+    for (int i = 0; !TryEmplace(std::move(value)); ++i) {
+      if (i < kSpinCount) {
+        Pause();
+        continue;
+      }
+
+      not_full_.PrepareWait();
+      if (TryEmplace(std::move(value))) {
+        not_full_.CancelWait();
+        break;
+      }
+      not_full_.CommitWait();
+    }
+  }
+
+ private:
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Producers and consumers each hammer their own position, keep them on
+  // separate cache lines.
+  char padding0_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char padding1_[64];
+  std::atomic<size_t> dequeue_pos_;
+  char padding2_[64];
+
+  EventCount not_empty_;
+  EventCount not_full_;
+
+  DISABLE_COPY_AND_ASSIGN(MpmcQueue);
+};
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_MPMC_QUEUE_H_
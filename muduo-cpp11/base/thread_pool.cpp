@@ -17,9 +17,45 @@ using std::string;
 
 namespace muduo_cpp11 {
 
+namespace {
+
+// The worker the current thread runs, NULL outside of any pool.
+thread_local void* t_current_worker = NULL;
+
+}  // namespace
+
+struct ThreadPool::Worker {
+  Worker(ThreadPool* owner, const size_t worker_index)
+      : pool(owner),
+        size(0),
+        seed(static_cast<uint32_t>(worker_index) * 2654435761u + 1) {
+  }
+
+  // Picks a victim to steal from, only called by the owner.
+  size_t NextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  ThreadPool* const pool;
+
+  // The owner pushes and pops at the back, thieves take from the front.
+  std::mutex mutex;
+  std::deque<Task> tasks;
+  // tasks.size(), readable without the lock.
+  std::atomic<size_t> size;
+
+  uint32_t seed;
+};
+
 ThreadPool::ThreadPool(const string& name)
-    : name_(name),
+    : num_injected_(0),
+      name_(name),
       max_queue_size_(0),
+      rejection_policy_(kReject),
+      rejected_count_(0),
       running_(false) {
 }
 
@@ -37,13 +73,19 @@ void ThreadPool::Start(const int num_threads) {
 
   assert(threads_.empty());
 
+  // Thieves walk workers_, so it is complete before any thread starts.
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker(this, i));
+  }
+
   // NOTE: Threads will check running_, so set running_ to true before starting
   // threads.
   running_ = true;
 
   threads_.reserve(num_threads);
   for (int i = 0; i < num_threads; ++i) {
-    threads_.emplace_back(new std::thread(std::bind(&ThreadPool::RunInThread, this)));
+    threads_.emplace_back(new std::thread(std::bind(&ThreadPool::RunInThread, this, workers_[i].get())));
   }
 
   if (num_threads == 0 && thread_init_callback_) {
@@ -55,15 +97,18 @@ void ThreadPool::Stop() {
   {
     std::unique_lock<std::mutex> lock(mutex_);
     running_ = false;
-    not_empty_.notify_all();
+    not_full_.notify_all();
   }
+  idle_workers_.NotifyAll();
 
   for (size_t i = 0; i < threads_.size(); ++i) {
     threads_[i]->join();
   }
+  threads_.clear();
+  workers_.clear();
 }
 
-void ThreadPool::Run(const Task& task) {
+void ThreadPool::Run(Task task) {
   assert(running_);
   if (!running_) {
     return;
@@ -71,50 +116,251 @@ void ThreadPool::Run(const Task& task) {
 
   if (threads_.empty()) {
     task();
+    return;
+  }
+
+  Worker* worker = CurrentWorker();
+  if (worker != NULL) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->tasks.push_back(std::move(task));
+    worker->size.fetch_add(1);
   } else {
     std::unique_lock<std::mutex> lock(mutex_);
-    while (IsFull()) {
+    while (IsFull() && running_) {
       not_full_.wait(lock);
     }
 
-    assert(!IsFull());
-    task_queue_.push_back(task);
-    not_empty_.notify_one();
+    if (!running_) {
+      return;
+    }
+
+    task_queue_.push_back(std::move(task));
+    num_injected_.fetch_add(1);
   }
+
+  idle_workers_.NotifyOne();
 }
 
-ThreadPool::Task ThreadPool::Take() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  while (task_queue_.empty() && running_) {
-    not_empty_.wait(lock);
+void ThreadPool::RunBatch(std::vector<Task> tasks) {
+  assert(running_);
+  if (!running_ || tasks.empty()) {
+    return;
   }
 
-  Task task;
-  if (!task_queue_.empty()) {
-    task = task_queue_.front();
-    task_queue_.pop_front();
-    if (max_queue_size_ > 0) {
-      not_full_.notify_one();
+  if (threads_.empty()) {
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      tasks[i]();
     }
+    return;
+  }
+
+  Worker* worker = CurrentWorker();
+  if (worker != NULL) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      for (size_t i = 0; i < tasks.size(); ++i) {
+        worker->tasks.push_back(std::move(tasks[i]));
+      }
+      worker->size.fetch_add(tasks.size());
+    }
+    idle_workers_.Notify(static_cast<int>(tasks.size()));
+    return;
+  }
+
+  // Takes the lock once unless the batch does not fit in the queue; then
+  // the part that fits is handed to the workers before waiting for room.
+  size_t pushed = 0;
+  while (pushed < tasks.size()) {
+    size_t begin = pushed;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (IsFull() && running_) {
+        not_full_.wait(lock);
+      }
+
+      if (!running_) {
+        return;
+      }
+
+      while (pushed < tasks.size() && !IsFull()) {
+        task_queue_.push_back(std::move(tasks[pushed++]));
+      }
+      num_injected_.fetch_add(pushed - begin);
+    }
+    idle_workers_.Notify(static_cast<int>(pushed - begin));
   }
-  return task;
+}
+
+bool ThreadPool::TryRun(Task&& task) {
+  assert(running_);
+  if (!running_) {
+    return false;
+  }
+
+  if (threads_.empty()) {
+    task();
+    return true;
+  }
+
+  Worker* worker = CurrentWorker();
+  if (worker != NULL) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      worker->tasks.push_back(std::move(task));
+      worker->size.fetch_add(1);
+    }
+    idle_workers_.NotifyOne();
+    return true;
+  }
+
+  // Dropped or run outside of the lock, either may take a while or submit
+  // to the pool again.
+  Task discarded;
+  bool caller_runs = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (IsFull()) {
+      switch (rejection_policy_) {
+        case kReject:
+          ++rejected_count_;
+          return false;
+        case kCallerRuns:
+          caller_runs = true;
+          break;
+        case kDiscardOldest:
+          discarded = std::move(task_queue_.front());
+          task_queue_.pop_front();
+          num_injected_.fetch_sub(1);
+          ++rejected_count_;
+          break;
+      }
+    }
+
+    if (!caller_runs) {
+      task_queue_.push_back(std::move(task));
+      num_injected_.fetch_add(1);
+    }
+  }
+
+  if (caller_runs) {
+    task();
+  } else {
+    idle_workers_.NotifyOne();
+  }
+  return true;
 }
 
 bool ThreadPool::IsFull() const {
   return max_queue_size_ > 0 && task_queue_.size() >= max_queue_size_;
 }
 
-void ThreadPool::RunInThread() {
+bool ThreadPool::HasWork() const {
+  if (num_injected_.load() > 0) {
+    return true;
+  }
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->size.load() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ThreadPool::Worker* ThreadPool::CurrentWorker() const {
+  Worker* worker = static_cast<Worker*>(t_current_worker);
+  return worker != NULL && worker->pool == this ? worker : NULL;
+}
+
+bool ThreadPool::TakeLocal(Worker* worker, Task* task) {
+  if (worker->size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  if (worker->tasks.empty()) {
+    return false;
+  }
+
+  *task = std::move(worker->tasks.back());
+  worker->tasks.pop_back();
+  worker->size.fetch_sub(1);
+  return true;
+}
+
+bool ThreadPool::TakeInjected(Task* task) {
+  if (num_injected_.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (task_queue_.empty()) {
+    return false;
+  }
+
+  *task = std::move(task_queue_.front());
+  task_queue_.pop_front();
+  num_injected_.fetch_sub(1);
+  if (max_queue_size_ > 0) {
+    not_full_.notify_one();
+  }
+  return true;
+}
+
+bool ThreadPool::Steal(Worker* thief, Task* task) {
+  const size_t num_workers = workers_.size();
+  const size_t start = thief->NextRandom() % num_workers;
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    Worker* victim = workers_[(start + i) % num_workers].get();
+    if (victim == thief || victim->size.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (victim->tasks.empty()) {
+      continue;
+    }
+
+    // The oldest task, the owner is busy with the newest ones.
+    *task = std::move(victim->tasks.front());
+    victim->tasks.pop_front();
+    victim->size.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::RunInThread(Worker* worker) {
+  t_current_worker = worker;
+
   try {
     if (thread_init_callback_) {
       thread_init_callback_();
     }
 
+    Task task;
     while (running_) {
-      Task task(Take());
-      if (task) {
+      if (TakeLocal(worker, &task) || TakeInjected(&task) || Steal(worker, &task)) {
+        // Let a parked worker share what is left.
+        if (num_injected_.load(std::memory_order_relaxed) > 0 ||
+            worker->size.load(std::memory_order_relaxed) > 0) {
+          idle_workers_.NotifyOne();
+        }
+
         task();
+        task = nullptr;
+        continue;
       }
+
+      // Re-check after announcing ourselves, a task submitted meanwhile
+      // either shows up here or its NotifyOne() wakes us.
+      idle_workers_.PrepareWait();
+      if (!running_ || HasWork()) {
+        idle_workers_.CancelWait();
+        continue;
+      }
+      idle_workers_.CommitWait();
     }
   } catch (const std::exception& ex) {
     fprintf(stderr, "exception caught in ThreadPool %s\n", name_.c_str());
@@ -124,6 +370,8 @@ void ThreadPool::RunInThread() {
     fprintf(stderr, "unknown exception caught in ThreadPool %s\n", name_.c_str());
     throw;  // rethrow
   }
+
+  t_current_worker = NULL;
 }
 
 }  // namespace muduo_cpp11
@@ -10,55 +10,121 @@
 #include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
-#include <functional>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "muduo-cpp11/base/event_count.h"
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/move_only_function.h"
 
 namespace muduo_cpp11 {
 
+/// Work-stealing thread pool.
+///
+/// Each worker owns a deque: tasks submitted from a worker go to the back
+/// of its own deque and are popped from the back (LIFO, cache-warm), idle
+/// workers steal from the front of a random victim's deque. Tasks
+/// submitted from other threads, e.g. I/O loops, go through a shared
+/// injection queue. Idle workers park on an EventCount, so submitting
+/// costs no wakeup syscall while all workers are busy.
+///
+/// Tasks are move only, so they may capture a std::unique_ptr:
+///
+///   std::future<std::string> json = pool.Submit([body]() { return Encode(*body); });
 class ThreadPool {
  public:
-  typedef std::function<void ()> Task;
+  typedef MoveOnlyFunction<void ()> Task;
+  typedef std::function<void ()> ThreadInitCallback;
+
+  /// What TryRun() does when the injection queue is full.
+  enum RejectionPolicy {
+    kReject,         // Return false, the task is left to the caller.
+    kCallerRuns,     // Run the task in the calling thread.
+    kDiscardOldest,  // Drop the oldest queued task to make room.
+  };
 
   explicit ThreadPool(const std::string& name = "ThreadPool");
   ~ThreadPool();
 
   // Must be called before Start().
+  // Bounds the injection queue; submissions from the pool's own workers
+  // never block.
   void set_max_queue_size(const int max_size) {
     max_queue_size_ = max_size;
   }
 
-  void set_thread_init_callback(const Task& cb) {
+  void set_thread_init_callback(const ThreadInitCallback& cb) {
     thread_init_callback_ = cb;
   }
 
+  void set_rejection_policy(const RejectionPolicy policy) {
+    rejection_policy_ = policy;
+  }
+
   void Start(const int num_threads);
   void Stop();
 
-  // Could block if max_queue_size_ > 0
-  void Run(const Task& f);
+  // Could block if max_queue_size_ > 0 and not called from a worker.
+  void Run(Task task);
+
+  /// Enqueues all of @tasks with one lock acquisition and one wakeup.
+  /// Could block like Run() while the queue has no room.
+  void RunBatch(std::vector<Task> tasks);
+
+  /// Never blocks. Returns false if the queue is full and the rejection
+  /// policy is kReject; @task is then not moved from.
+  bool TryRun(Task&& task);
+
+  /// Runs @f in the pool; the future gets its result or exception.
+  template <typename F>
+  std::future<typename std::result_of<F ()>::type> Submit(F&& f) {
+    typedef typename std::result_of<F ()>::type Result;
+    std::packaged_task<Result ()> task(std::forward<F>(f));
+    std::future<Result> result = task.get_future();
+    Run(Task(std::move(task)));
+    return result;
+  }
+
+  /// Tasks dropped by TryRun() under kDiscardOldest or rejected under
+  /// kReject.
+  size_t rejected_count() const {
+    return rejected_count_;
+  }
 
  private:
+  struct Worker;
+
   bool IsFull() const;
-  void RunInThread();
-  Task Take();
+  bool HasWork() const;
+  Worker* CurrentWorker() const;
+  void RunInThread(Worker* worker);
+  bool TakeLocal(Worker* worker, Task* task);
+  bool TakeInjected(Task* task);
+  bool Steal(Worker* thief, Task* task);
 
  private:
+  // Guards task_queue_, the injection queue.
   std::mutex mutex_;
-  std::condition_variable not_empty_;
   std::condition_variable not_full_;
+  std::atomic<size_t> num_injected_;
 
   std::string name_;
-  Task thread_init_callback_;
+  ThreadInitCallback thread_init_callback_;
   std::vector<std::unique_ptr<std::thread>> threads_;
+  std::vector<std::unique_ptr<Worker>> workers_;
   std::deque<Task> task_queue_;
+  EventCount idle_workers_;
 
   size_t max_queue_size_;
+  RejectionPolicy rejection_policy_;
+  std::atomic<size_t> rejected_count_;
   std::atomic<bool> running_;
 
   DISABLE_COPY_AND_ASSIGN(ThreadPool);
@@ -55,6 +55,14 @@ class Timestamp {
   /// Get time of now.
   ///
   static Timestamp Now();
+
+  ///
+  /// Gets time since an unspecified point, e.g. boot, from
+  /// CLOCK_MONOTONIC, which clock steps (NTP, settimeofday) do not move.
+  /// Only meaningful in differences with other monotonic timestamps, e.g.
+  /// for timers and idle times, never display it or compare it with Now().
+  ///
+  static Timestamp MonotonicNow();
   static Timestamp Invalid();
 
   static const int kMicroSecondsPerSecond = 1000 * 1000;
@@ -0,0 +1,88 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#ifndef MUDUO_CPP11_BASE_TOKEN_BUCKET_H_
+#define MUDUO_CPP11_BASE_TOKEN_BUCKET_H_
+
+#include <stddef.h>
+
+#include "muduo-cpp11/base/timestamp.h"
+
+namespace muduo_cpp11 {
+
+///
+/// Token bucket for rate limiting, NOT thread safe.
+///
+/// Consume() may take more tokens than available, the debt is paid back
+/// before tokens become available again, so the average rate holds even
+/// if the caller can't split its work, e.g. one read(2) of 64k.
+///
+class TokenBucket {
+ public:
+  ///
+  /// Constructs a disabled bucket, which never limits anything.
+  ///
+  TokenBucket()
+      : rate_(0.0),
+        burst_(0.0),
+        tokens_(0.0) {
+  }
+
+  ///
+  /// @param rate tokens per second, <= 0 disables the bucket
+  /// @param burst the capacity of the bucket, which starts full
+  TokenBucket(double rate, double burst, Timestamp now)
+      : rate_(rate),
+        burst_(burst),
+        tokens_(burst),
+        last_refill_(now) {
+  }
+
+  // default copy/assignment/dtor are Okay
+
+  bool enabled() const {
+    return rate_ > 0.0;
+  }
+
+  ///
+  /// Gets the whole tokens available at @c now.
+  ///
+  size_t Available(Timestamp now) {
+    Refill(now);
+    return tokens_ >= 1.0 ? static_cast<size_t>(tokens_) : 0;
+  }
+
+  void Consume(size_t n) {
+    tokens_ -= static_cast<double>(n);
+  }
+
+  ///
+  /// Seconds to wait from the last refill until @c n tokens are available.
+  ///
+  double SecondsUntilAvailable(size_t n) const {
+    double lack = static_cast<double>(n) - tokens_;
+    return lack > 0.0 ? lack / rate_ : 0.0;
+  }
+
+ private:
+  void Refill(Timestamp now) {
+    if (last_refill_ < now) {
+      tokens_ += TimeDifference(now, last_refill_) * rate_;
+      if (tokens_ > burst_) {
+        tokens_ = burst_;
+      }
+      last_refill_ = now;
+    }
+  }
+
+  double rate_;
+  double burst_;
+  double tokens_;
+  Timestamp last_refill_;
+};
+
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_BASE_TOKEN_BUCKET_H_
@@ -18,6 +18,7 @@
 
 #include <functional>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/net/channel.h"
 #include "muduo-cpp11/net/event_loop.h"
@@ -35,6 +36,7 @@ Acceptor::Acceptor(EventLoop* loop,
       accept_socket_ptr_(new Socket(sockets::CreateNonblockingOrDie())),
       accept_channel_ptr_(new Channel(loop, accept_socket_ptr_->fd())),
       listenning_(false),
+      accepting_(false),
       idle_fd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
   CHECK(idle_fd_ >= 0, "Failed to check idle_fd_");
@@ -46,7 +48,7 @@ Acceptor::Acceptor(EventLoop* loop,
   accept_socket_ptr_->set_reuseport(reuseport);
   accept_socket_ptr_->BindAddress(listen_addr);
 
-  accept_channel_ptr_->set_read_callback(std::bind(&Acceptor::HandleRead, this));
+  accept_channel_ptr_->set_handler(this);
 }
 
 Acceptor::~Acceptor() {
@@ -60,9 +62,26 @@ void Acceptor::Listen() {
   listenning_ = true;
   accept_socket_ptr_->Listen();
   accept_channel_ptr_->EnableReading();
+  accepting_ = true;
 }
 
-void Acceptor::HandleRead() {
+void Acceptor::DisableAccepting() {
+  loop_->AssertInLoopThread();
+  if (accepting_) {
+    accepting_ = false;
+    accept_channel_ptr_->DisableReading();
+  }
+}
+
+void Acceptor::EnableAccepting() {
+  loop_->AssertInLoopThread();
+  if (listenning_ && !accepting_) {
+    accepting_ = true;
+    accept_channel_ptr_->EnableReading();
+  }
+}
+
+void Acceptor::HandleRead(Timestamp receive_time) {
   loop_->AssertInLoopThread();
   InetAddress peer_addr;
 
@@ -78,9 +97,9 @@ void Acceptor::HandleRead() {
     }
   } else {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-    LogError("Accept failed in Acceptor::HandleRead");
+    LogRateLimited(LogError, 10, "Accept failed in Acceptor::HandleRead");
 #else
-    LOG(ERROR) << "Accept failed in Acceptor::HandleRead";
+    LOG_RATE_LIMITED(ERROR, 10) << "Accept failed in Acceptor::HandleRead";
 #endif
 
     // Read the section named "The special problem of
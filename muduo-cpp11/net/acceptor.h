@@ -16,6 +16,7 @@
 #include <functional>
 
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/net/channel_handler.h"
 
 namespace muduo_cpp11 {
 namespace net {
@@ -28,7 +29,7 @@ class Socket;
 ///
 /// Acceptor of incoming TCP connections.
 ///
-class Acceptor {
+class Acceptor : private ChannelHandler {
  public:
   typedef std::function<void (int sockfd, const InetAddress&)> NewConnectionCallback;
 
@@ -45,8 +46,18 @@ class Acceptor {
 
   void Listen();
 
+  /// Stops/restarts polling the listening socket, pending connections
+  /// wait in the kernel backlog meanwhile. Must be called in loop thread.
+  void DisableAccepting();
+  void EnableAccepting();
+
+  bool accepting() const {
+    return accepting_;
+  }
+
  private:
-  void HandleRead();
+  // ChannelHandler
+  virtual void HandleRead(Timestamp receive_time);
 
  private:
   EventLoop* loop_;
@@ -56,6 +67,7 @@ class Acceptor {
   std::unique_ptr<Channel> accept_channel_ptr_;
 
   bool listenning_;
+  bool accepting_;
   int idle_fd_;
 
   DISABLE_COPY_AND_ASSIGN(Acceptor);
@@ -15,6 +15,7 @@
 #include <memory>
 #include <functional>
 
+#include "muduo-cpp11/base/move_only_function.h"
 #include "muduo-cpp11/base/timestamp.h"
 #include "muduo-cpp11/base/type_conversion.h"
 
@@ -43,7 +44,7 @@ class Buffer;
 class TcpConnection;
 
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
-typedef std::function<void()> TimerCallback;
+typedef MoveOnlyFunction<void ()> TimerCallback;
 typedef std::function<void (const TcpConnectionPtr&)> ConnectionCallback;
 typedef std::function<void (const TcpConnectionPtr&)> CloseCallback;
 typedef std::function<void (const TcpConnectionPtr&)> WriteCompleteCallback;
@@ -54,6 +55,48 @@ typedef std::function<void (const TcpConnectionPtr&,
                             Buffer*,
                             Timestamp)> MessageCallback;
 
+///
+/// A connection lent to a callback, usable only in its loop thread and
+/// until the callback returns. Passing it costs no reference counting,
+/// unlike a TcpConnectionPtr; Retain() the connection to keep it, or to
+/// hand it to another thread.
+///
+/// Nothing but the owner, TcpServer or TcpClient, keeps the connection
+/// alive meanwhile. The callback may close it, or destroy the owner, which
+/// releases it only from a queued functor. It must not:
+///   - release a TcpConnectionPtr which may be the last reference, e.g.
+///     one kept beside a TcpClient destroyed from the callback,
+///   - call ConnectDestroyed(),
+///   - use the reference after returning, Retain() it instead.
+class TcpConnectionRef {
+ public:
+  explicit TcpConnectionRef(TcpConnection* conn)
+      : conn_(conn) {
+  }
+
+  TcpConnection* operator->() const {
+    return conn_;
+  }
+
+  TcpConnection& operator*() const {
+    return *conn_;
+  }
+
+  TcpConnection* get() const {
+    return conn_;
+  }
+
+  // Defined in tcp_connection.h.
+  TcpConnectionPtr Retain() const;
+
+ private:
+  TcpConnection* conn_;
+};
+
+typedef std::function<void (TcpConnectionRef,
+                            Buffer*,
+                            Timestamp)> BorrowedMessageCallback;
+
 void DefaultConnectionCallback(const TcpConnectionPtr& conn);
 void DefaultMessageCallback(const TcpConnectionPtr& conn,
                             Buffer* buffer,
@@ -15,6 +15,7 @@
 #include <sstream>
 #include <string>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/net/event_loop.h"
 
@@ -36,7 +37,8 @@ Channel::Channel(EventLoop* loop, int fd)
       log_hup_(true),
       tied_(false),
       event_handling_(false),
-      added_to_loop_(false) {
+      added_to_loop_(false),
+      handler_(NULL) {
 }
 
 Channel::~Channel() {
@@ -52,6 +54,18 @@ void Channel::Tie(const std::shared_ptr<void>& obj) {
   tied_ = true;
 }
 
+void Channel::Reset(int fd) {
+  assert(!event_handling_);
+  assert(!added_to_loop_);
+  fd_ = fd;
+  events_ = kNoneEvent;
+  revents_ = 0;
+  index_ = -1;
+  log_hup_ = true;
+  tie_.reset();
+  tied_ = false;
+}
+
 void Channel::Update() {
   added_to_loop_ = true;
   loop_->UpdateChannel(this);
@@ -64,9 +78,8 @@ void Channel::Remove() {
 }
 
 void Channel::HandleEvent(Timestamp receive_time) {
-  std::shared_ptr<void> guard;
   if (tied_) {
-    guard = tie_.lock();
+    std::shared_ptr<void> guard(tie_.lock());
     if (guard) {
       HandleEventWithGuard(receive_time);
     }
@@ -86,27 +99,33 @@ void Channel::HandleEventWithGuard(Timestamp receive_time) {
   if ((revents_ & POLLHUP) && !(revents_ & POLLIN)) {
     if (log_hup_) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-      LogWarn("Channel::handle_event() POLLHUP");
+      LogSampled(LogWarn, 100, "Channel::handle_event() POLLHUP");
 #else
-      LOG(WARNING) << "Channel::handle_event() POLLHUP";
+      LOG_SAMPLED(WARNING, 100) << "Channel::handle_event() POLLHUP";
 #endif
     }
 
-    if (close_callback_) {
+    if (handler_ != NULL) {
+      handler_->HandleClose();
+    } else if (close_callback_) {
       close_callback_();
     }
   }
 
   if (revents_ & POLLNVAL) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-    LogWarn("Channel::handle_event() POLLNVAL");
+    LogSampled(LogWarn, 100, "Channel::handle_event() POLLNVAL");
 #else
-    LOG(WARNING) << "Channel::handle_event() POLLNVAL";
+    LOG_SAMPLED(WARNING, 100) << "Channel::handle_event() POLLNVAL";
 #endif
   }
 
   if (revents_ & (POLLERR | POLLNVAL)) {
-    if (error_callback_) error_callback_();
+    if (handler_ != NULL) {
+      handler_->HandleError();
+    } else if (error_callback_) {
+      error_callback_();
+    }
   }
 
 #ifndef POLLRDHUP
@@ -114,11 +133,19 @@ void Channel::HandleEventWithGuard(Timestamp receive_time) {
 #endif
 
   if (revents_ & (POLLIN | POLLPRI | POLLRDHUP)) {
-    if (read_callback_) read_callback_(receive_time);
+    if (handler_ != NULL) {
+      handler_->HandleRead(receive_time);
+    } else if (read_callback_) {
+      read_callback_(receive_time);
+    }
   }
 
   if (revents_ & POLLOUT) {
-    if (write_callback_) write_callback_();
+    if (handler_ != NULL) {
+      handler_->HandleWrite();
+    } else if (write_callback_) {
+      write_callback_();
+    }
   }
 
   event_handling_ = false;
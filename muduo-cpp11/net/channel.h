@@ -15,9 +15,12 @@
 #include <memory>
 #include <functional>
 #include <string>
+#include <utility>
 
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/move_only_function.h"
 #include "muduo-cpp11/base/timestamp.h"
+#include "muduo-cpp11/net/channel_handler.h"
 
 namespace muduo_cpp11 {
 namespace net {
@@ -30,30 +33,41 @@ class EventLoop;
 /// This class doesn't own the file descriptor.
 /// The file descriptor could be a socket,
 /// an eventfd, a timerfd, or a signalfd
+///
+/// Events go either to a ChannelHandler, which costs one virtual call
+/// each, or to the callbacks, with the owner optionally tied.
 class Channel {
  public:
-  typedef std::function<void()> EventCallback;
-  typedef std::function<void(Timestamp)> ReadEventCallback;
+  typedef MoveOnlyFunction<void ()> EventCallback;
+  typedef MoveOnlyFunction<void (Timestamp)> ReadEventCallback;
 
   Channel(EventLoop* loop, int fd);
   ~Channel();
 
   void HandleEvent(Timestamp receive_time);
 
-  void set_read_callback(const ReadEventCallback& cb) {
-    read_callback_ = cb;
+  void set_read_callback(ReadEventCallback cb) {
+    read_callback_ = std::move(cb);
+  }
+
+  void set_write_callback(EventCallback cb) {
+    write_callback_ = std::move(cb);
   }
 
-  void set_write_callback(const EventCallback& cb) {
-    write_callback_ = cb;
+  void set_close_callback(EventCallback cb) {
+    close_callback_ = std::move(cb);
   }
 
-  void set_close_callback(const EventCallback& cb) {
-    close_callback_ = cb;
+  void set_error_callback(EventCallback cb) {
+    error_callback_ = std::move(cb);
   }
 
-  void set_error_callback(const EventCallback& cb) {
-    error_callback_ = cb;
+  /// Dispatches events to @handler instead of the callbacks. Unless the
+  /// channel is tied, the handler must not be destroyed while the loop may
+  /// still handle events of this channel, i.e. only from a functor queued
+  /// after Remove() or from the channel's own loop outside of HandleEvent().
+  void set_handler(ChannelHandler* handler) {
+    handler_ = handler;
   }
 
   /// Tie this channel to the owner object managed by shared_ptr,
@@ -61,6 +75,10 @@ class Channel {
   void Tie(const std::shared_ptr<void>&);
 
   int fd() const { return fd_; }
+
+  /// Rebinds a removed channel to another fd, keeping the callbacks.
+  /// Used when a pooled TcpConnection is reused for a new socket.
+  void Reset(int fd);
   int events() const { return events_; }
   void set_revents(int revt) { revents_ = revt; }  // used by pollers
   // int revents() const { return revents_; }
@@ -72,6 +90,7 @@ class Channel {
   void DisableWriting() { events_ &= ~kWriteEvent; Update(); }
   void DisableAll() { events_ = kNoneEvent; Update(); }
   bool IsWriting() const { return events_ & kWriteEvent; }
+  bool IsReading() const { return events_ & kReadEvent; }
 
   // for Poller
   int index() { return index_; }
@@ -97,7 +116,7 @@ class Channel {
   static const int kWriteEvent;
 
   EventLoop* loop_;
-  const int fd_;
+  int fd_;
 
   int events_;
   int revents_;  // it's the received event types of epoll or poll.
@@ -109,6 +128,7 @@ class Channel {
   bool event_handling_;
   bool added_to_loop_;
 
+  ChannelHandler* handler_;
   ReadEventCallback read_callback_;
   EventCallback write_callback_;
   EventCallback close_callback_;
@@ -0,0 +1,43 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_CPP11_NET_CHANNEL_HANDLER_H_
+#define MUDUO_CPP11_NET_CHANNEL_HANDLER_H_
+
+#include "muduo-cpp11/base/timestamp.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+///
+/// Receives the events of a Channel through virtual calls, an alternative
+/// to its four callbacks; see Channel::set_handler().
+///
+/// Implemented by the classes owning a channel: TcpConnection, Acceptor,
+/// Connector and TimerQueue.
+class ChannelHandler {
+ public:
+  virtual ~ChannelHandler() {
+  }
+
+  virtual void HandleRead(Timestamp receive_time) {
+  }
+
+  virtual void HandleWrite() {
+  }
+
+  virtual void HandleClose() {
+  }
+
+  virtual void HandleError() {
+  }
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_CHANNEL_HANDLER_H_
@@ -141,8 +141,7 @@ void Connector::Connecting(int sockfd) {
   SetState(kConnecting);
   assert(!channel_);
   channel_.reset(new Channel(loop_, sockfd));
-  channel_->set_write_callback(std::bind(&Connector::HandleWrite, this));  // FIXME: unsafe
-  channel_->set_error_callback(std::bind(&Connector::HandleError, this));  // FIXME: unsafe
+  channel_->set_handler(this);  // FIXME: unsafe
 
   // channel_->Tie(shared_from_this()); is not working,
   // as channel_ is not managed by shared_ptr
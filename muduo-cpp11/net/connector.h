@@ -17,6 +17,7 @@
 #include <functional>
 
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/net/channel_handler.h"
 #include "muduo-cpp11/net/inet_address.h"
 
 namespace muduo_cpp11 {
@@ -25,7 +26,8 @@ namespace net {
 class Channel;
 class EventLoop;
 
-class Connector : public std::enable_shared_from_this<Connector> {
+class Connector : public std::enable_shared_from_this<Connector>,
+                  private ChannelHandler {
  public:
   typedef std::function<void (int sockfd)> NewConnectionCallback;
 
@@ -60,8 +62,9 @@ class Connector : public std::enable_shared_from_this<Connector> {
   void StopInLoop();
   void Connect();
   void Connecting(int sockfd);
-  void HandleWrite();
-  void HandleError();
+  // ChannelHandler
+  virtual void HandleWrite();
+  virtual void HandleError();
   void Retry(int sockfd);
   int RemoveAndResetChannel();
   void ResetChannel();
@@ -0,0 +1,608 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_CPP11_NET_COROUTINE_H_
+#define MUDUO_CPP11_NET_COROUTINE_H_
+
+// The library itself is C++11, the coroutine layer is header only and
+// available to code built as C++20.
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/net/buffer.h"
+#include "muduo-cpp11/net/callbacks.h"
+#include "muduo-cpp11/net/event_loop.h"
+#include "muduo-cpp11/net/tcp_client.h"
+#include "muduo-cpp11/net/tcp_connection.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+///
+/// Awaitable primitives for writing protocol handlers as straight-line
+/// code instead of state machines on MessageCallback:
+///
+///   coro::Task<void> Echo(coro::Connection conn) {
+///     for (;;) {
+///       std::string line = co_await conn.ReadUntil("\n");
+///       if (line.empty() || !co_await conn.Write(line)) {
+///         break;
+///       }
+///     }
+///   }
+///
+///   void OnConnection(const TcpConnectionPtr& conn) {
+///     if (conn->connected()) {
+///       coro::Spawn(Echo(coro::Connection(conn)));
+///     }
+///   }
+///
+/// Coroutines run in the loop thread they were spawned in, and every
+/// awaitable resumes them there, from the loop's own callbacks.
+///
+namespace coro {
+
+/// Coroutine frames come from free lists of the thread, i.e. of the loop
+/// running the coroutine, so a server spawning a handler per connection
+/// does not go to malloc once the lists are warm.
+class FrameAllocator {
+ public:
+  static void* Allocate(const size_t size) {
+    size_t index = SizeClass(size);
+    if (index >= kNumSizeClasses) {
+      return ::operator new(size);
+    }
+
+    FreeBlock*& head = Current()->free_lists_[index];
+    if (head == NULL) {
+      return ::operator new((index + 1) * kGranularity);
+    }
+
+    FreeBlock* block = head;
+    head = block->next;
+    return block;
+  }
+
+  /// May be called in another thread, the block then goes to its lists.
+  static void Deallocate(void* p, const size_t size) {
+    size_t index = SizeClass(size);
+    if (index >= kNumSizeClasses) {
+      ::operator delete(p);
+      return;
+    }
+
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    FreeBlock*& head = Current()->free_lists_[index];
+    block->next = head;
+    head = block;
+  }
+
+ private:
+  static const size_t kGranularity = 64;
+  static const size_t kNumSizeClasses = 32;  // up to 2KB
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  FrameAllocator() {
+    memset(free_lists_, 0, sizeof(free_lists_));
+  }
+
+  ~FrameAllocator() {
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+      while (free_lists_[i] != NULL) {
+        FreeBlock* block = free_lists_[i];
+        free_lists_[i] = block->next;
+        ::operator delete(block);
+      }
+    }
+  }
+
+  static size_t SizeClass(const size_t size) {
+    return (size + kGranularity - 1) / kGranularity - 1;
+  }
+
+  static FrameAllocator* Current() {
+    static thread_local FrameAllocator t_allocator;
+    return &t_allocator;
+  }
+
+  FreeBlock* free_lists_[kNumSizeClasses];
+
+  DISABLE_COPY_AND_ASSIGN(FrameAllocator);
+};
+
+template <typename T> class Task;
+
+namespace internal {
+
+class PromiseBase {
+ public:
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      PromiseBase& promise = h.promise();
+      if (promise.detached_) {
+        h.destroy();
+        return std::noop_coroutine();
+      }
+      return promise.continuation_;
+    }
+
+    void await_resume() const noexcept {
+    }
+  };
+
+  PromiseBase()
+      : detached_(false) {
+  }
+
+  static void* operator new(const size_t size) {
+    return FrameAllocator::Allocate(size);
+  }
+
+  static void operator delete(void* p, const size_t size) {
+    FrameAllocator::Deallocate(p, size);
+  }
+
+  std::suspend_always initial_suspend() const noexcept {
+    return std::suspend_always();
+  }
+
+  FinalAwaiter final_suspend() const noexcept {
+    return FinalAwaiter();
+  }
+
+  void unhandled_exception() {
+    // Nobody is there to catch it for a spawned coroutine.
+    if (detached_) {
+      std::terminate();
+    }
+    exception_ = std::current_exception();
+  }
+
+  void set_continuation(std::coroutine_handle<> continuation) {
+    continuation_ = continuation;
+  }
+
+  void set_detached() {
+    detached_ = true;
+  }
+
+ protected:
+  void RethrowIfFailed() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+ private:
+  std::coroutine_handle<> continuation_;
+  std::exception_ptr exception_;
+  bool detached_;
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+ public:
+  Task<T> get_return_object();
+
+  template <typename U>
+  void return_value(U&& value) {
+    value_ = std::forward<U>(value);
+  }
+
+  T Result() {
+    RethrowIfFailed();
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+ public:
+  Task<void> get_return_object();
+
+  void return_void() {
+  }
+
+  void Result() {
+    RethrowIfFailed();
+  }
+};
+
+}  // namespace internal
+
+/// A lazily started coroutine returning T, started by co_await-ing it from
+/// another coroutine or by Spawn().
+template <typename T>
+class Task {
+ public:
+  typedef internal::Promise<T> promise_type;
+
+  Task(Task&& rhs) noexcept
+      : handle_(rhs.handle_) {
+    rhs.handle_ = nullptr;
+  }
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().set_continuation(awaiting);
+    return handle_;
+  }
+
+  T await_resume() {
+    return handle_.promise().Result();
+  }
+
+ private:
+  friend class internal::Promise<T>;
+  friend void Spawn(Task<void> task);
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+
+  DISABLE_COPY_AND_ASSIGN(Task);
+};
+
+namespace internal {
+
+template <typename T>
+inline Task<T> Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace internal
+
+/// Starts @task right away; its frame is freed when it finishes. Must be
+/// called in the loop thread the task is meant to run in.
+inline void Spawn(Task<void> task) {
+  std::coroutine_handle<internal::Promise<void>> handle = task.handle_;
+  task.handle_ = nullptr;
+  handle.promise().set_detached();
+  handle.resume();
+}
+
+/// co_await SleepFor(loop, 0.5) resumes after half a second.
+class SleepFor {
+ public:
+  SleepFor(EventLoop* loop, const double seconds)
+      : loop_(loop),
+        seconds_(seconds) {
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    loop_->RunAfter(seconds_, [h]() { h.resume(); });
+  }
+
+  void await_resume() const noexcept {
+  }
+
+ private:
+  EventLoop* loop_;
+  double seconds_;
+};
+
+/// A TcpConnection as seen by one coroutine. Takes over the connection,
+/// write complete and message callbacks of @conn; data which arrives while
+/// nobody reads stays in the input buffer.
+///
+/// Reads return an empty string, and writes false, once the connection
+/// is closed.
+class Connection {
+ public:
+  explicit Connection(const TcpConnectionPtr& conn)
+      : conn_(conn),
+        state_(std::make_shared<State>()) {
+    std::shared_ptr<State> state(state_);
+    conn_->set_message_callback([state](const TcpConnectionPtr&, Buffer*, Timestamp) {
+      state->OnMessage();
+    });
+    conn_->set_write_complete_callback([state](const TcpConnectionPtr&) {
+      state->OnWriteComplete();
+    });
+    conn_->set_connection_callback([state](const TcpConnectionPtr& c) {
+      if (!c->connected()) {
+        state->OnClose();
+      }
+    });
+  }
+
+  const TcpConnectionPtr& connection() const {
+    return conn_;
+  }
+
+ private:
+  // Shared with the callbacks installed on the connection, which outlive
+  // this object as long as the TcpConnection does.
+  struct State {
+    State()
+        : closed(false) {
+    }
+
+    void OnMessage() {
+      if (reader && read_ready()) {
+        ResumeReader();
+      }
+    }
+
+    void OnWriteComplete() {
+      if (writer) {
+        std::exchange(writer, nullptr).resume();
+      }
+    }
+
+    void OnClose() {
+      closed = true;
+      // Resuming the reader may end the coroutine, take the writer first.
+      std::coroutine_handle<> pending_writer = std::exchange(writer, nullptr);
+      if (reader) {
+        bool ready = read_ready();
+        assert(ready);
+        (void) ready;
+        ResumeReader();
+      }
+      if (pending_writer) {
+        pending_writer.resume();
+      }
+    }
+
+    void ResumeReader() {
+      read_ready = nullptr;
+      std::exchange(reader, nullptr).resume();
+    }
+
+    bool closed;
+    std::coroutine_handle<> reader;
+    std::function<bool ()> read_ready;
+    std::coroutine_handle<> writer;
+  };
+
+ public:
+  class ReadAwaiter {
+   public:
+    bool await_ready() {
+      return Ready();
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      assert(!state_->reader);
+      state_->reader = h;
+      state_->read_ready = [this]() { return Ready(); };
+    }
+
+    std::string await_resume() {
+      if (length_ == 0) {
+        return std::string();
+      }
+      return conn_->input_buffer()->RetrieveAsString(length_);
+    }
+
+   private:
+    friend class Connection;
+
+    ReadAwaiter(Connection* conn, const StringPiece& delimiter, const size_t length)
+        : conn_(conn->conn_.get()),
+          state_(conn->state_.get()),
+          delimiter_(delimiter),
+          length_(length) {
+    }
+
+    // Sets length_ to the number of bytes to retrieve, 0 if closed first.
+    bool Ready() {
+      Buffer* buffer = conn_->input_buffer();
+      if (delimiter_.empty()) {
+        if (buffer->ReadableBytes() >= length_) {
+          return true;
+        }
+      } else {
+        const char* begin = buffer->Peek();
+        const char* end = begin + buffer->ReadableBytes();
+        const char* found = std::search(begin, end, delimiter_.begin(), delimiter_.end());
+        if (found != end) {
+          length_ = found - begin + delimiter_.size();
+          return true;
+        }
+      }
+
+      if (state_->closed) {
+        length_ = 0;
+        return true;
+      }
+      return false;
+    }
+
+    TcpConnection* conn_;
+    State* state_;
+    StringPiece delimiter_;
+    size_t length_;
+  };
+
+  class WriteAwaiter {
+   public:
+    bool await_ready() {
+      if (state_->closed) {
+        return true;
+      }
+      conn_->Send(data_);
+      return conn_->output_buffer()->ReadableBytes() == 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      assert(!state_->writer);
+      state_->writer = h;
+    }
+
+    bool await_resume() const {
+      return !state_->closed;
+    }
+
+   private:
+    friend class Connection;
+
+    WriteAwaiter(Connection* conn, const StringPiece& data)
+        : conn_(conn->conn_.get()),
+          state_(conn->state_.get()),
+          data_(data) {
+    }
+
+    TcpConnection* conn_;
+    State* state_;
+    StringPiece data_;
+  };
+
+  /// Resumes with everything up to and including @delimiter, which must
+  /// stay valid until then.
+  ReadAwaiter ReadUntil(const StringPiece& delimiter) {
+    assert(!delimiter.empty());
+    return ReadAwaiter(this, delimiter, 0);
+  }
+
+  /// Resumes with exactly @length bytes.
+  ReadAwaiter Read(const size_t length) {
+    return ReadAwaiter(this, StringPiece(), length);
+  }
+
+  /// Sends @data, which must stay valid until co_await-ed, and resumes once
+  /// the output buffer is drained; a fast producer does not pile up data
+  /// for a slow peer.
+  WriteAwaiter Write(const StringPiece& data) {
+    return WriteAwaiter(this, data);
+  }
+
+ private:
+  TcpConnectionPtr conn_;
+  std::shared_ptr<State> state_;
+};
+
+/// co_await Connect(&client) starts connecting @client, which must not be
+/// connected yet, and resumes with the new connection. The client retries
+/// until it gets one, or until it is stopped, then it resumes with a null
+/// TcpConnectionPtr. Meanwhile the client's connection and stop callbacks
+/// are still called, and once resumed they are set back; @client must
+/// outlive the co_await.
+class Connect {
+ public:
+  explicit Connect(TcpClient* client)
+      : client_(client) {
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    // The slot makes sure a reconnection or a Stop() racing with the
+    // connection does not resume this coroutine twice.
+    std::shared_ptr<Slot> slot(std::make_shared<Slot>());
+    slot->awaiter = this;
+    slot->handle = h;
+    slot->connection_callback = client_->connection_callback();
+    slot->stop_callback = client_->stop_callback();
+    client_->set_connection_callback([slot](const TcpConnectionPtr& conn) {
+      OnConnection(slot, conn);
+    });
+    client_->set_stop_callback([slot]() {
+      OnStop(slot);
+    });
+    client_->Connect();
+  }
+
+  TcpConnectionPtr await_resume() {
+    return std::move(conn_);
+  }
+
+ private:
+  struct Slot {
+    Connect* awaiter;
+    std::coroutine_handle<> handle;
+    ConnectionCallback connection_callback;
+    TcpClient::StopCallback stop_callback;
+  };
+
+  // @slot by value, Resume() destroys the lambdas holding it.
+  static void OnConnection(std::shared_ptr<Slot> slot, const TcpConnectionPtr& conn) {
+    if (slot->connection_callback) {
+      slot->connection_callback(conn);
+    }
+    if (conn->connected() && slot->handle) {
+      conn->set_connection_callback(slot->connection_callback);
+      Resume(slot, conn);
+    }
+  }
+
+  static void OnStop(std::shared_ptr<Slot> slot) {
+    if (slot->stop_callback) {
+      slot->stop_callback();
+    }
+    if (slot->handle) {
+      Resume(slot, TcpConnectionPtr());
+    }
+  }
+
+  static void Resume(const std::shared_ptr<Slot>& slot, const TcpConnectionPtr& conn) {
+    Connect* awaiter = slot->awaiter;
+    awaiter->client_->set_connection_callback(slot->connection_callback);
+    awaiter->client_->set_stop_callback(slot->stop_callback);
+    awaiter->conn_ = conn;
+    std::exchange(slot->handle, nullptr).resume();
+  }
+
+  TcpClient* client_;
+  TcpConnectionPtr conn_;
+};
+
+}  // namespace coro
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#endif  // MUDUO_CPP11_NET_COROUTINE_H_
@@ -78,6 +78,8 @@ EventLoop::EventLoop()
       calling_pending_functors_(false),
       iteration_(0),
       thread_id_(gettid()),
+      cached_now_(Timestamp::MonotonicNow()),
+      wall_clock_offset_(0),
       poller_(Poller::NewDefaultPoller(this)),
       timer_queue_(new TimerQueue(this)),
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
@@ -146,10 +148,17 @@ void EventLoop::Loop() {
     active_channels_.clear();
 
 #if defined(__MACH__) || defined(__ANDROID_API__)
-    poll_return_time_ = poller_->Poll(timer_queue_->GetTimeout(), &active_channels_);
+    cached_now_ = poller_->Poll(timer_queue_->GetTimeout(), &active_channels_);
 #else
-    poll_return_time_ = poller_->Poll(kPollTimeMs, &active_channels_);
+    cached_now_ = poller_->Poll(kPollTimeMs, &active_channels_);
 #endif
+    // One clock read per iteration, the wall clock is read once a second.
+    if (!(cached_now_ < next_wall_clock_sync_)) {
+      wall_clock_offset_ = Timestamp::Now().microseconds_since_epoch() -
+                           cached_now_.microseconds_since_epoch();
+      next_wall_clock_sync_ = AddTime(cached_now_, 1.0);
+    }
+    poll_return_time_ = Timestamp(cached_now_.microseconds_since_epoch() + wall_clock_offset_);
 
     ++iteration_;
 
@@ -197,18 +206,18 @@ void EventLoop::Quit() {
   }
 }
 
-void EventLoop::RunInLoop(const Functor& cb) {
+void EventLoop::RunInLoop(Functor cb) {
   if (IsInLoopThread()) {
     cb();
   } else {
-    QueueInLoop(cb);
+    QueueInLoop(std::move(cb));
   }
 }
 
-void EventLoop::QueueInLoop(const Functor& cb) {
+void EventLoop::QueueInLoop(Functor cb) {
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    pending_functors_.push_back(cb);
+    pending_functors_.push_back(std::move(cb));
   }
 
   if (!IsInLoopThread() || calling_pending_functors_) {
@@ -216,18 +225,18 @@ void EventLoop::QueueInLoop(const Functor& cb) {
   }
 }
 
-TimerId EventLoop::RunAt(const Timestamp& time, const TimerCallback& cb) {
-  return timer_queue_->AddTimer(cb, time, 0.0);
+TimerId EventLoop::RunAt(const Timestamp& time, TimerCallback cb) {
+  return RunAfter(TimeDifference(time, Timestamp::Now()), std::move(cb));
 }
 
-TimerId EventLoop::RunAfter(double delay, const TimerCallback& cb) {
-  Timestamp time(AddTime(Timestamp::Now(), delay));
-  return RunAt(time, cb);
+TimerId EventLoop::RunAfter(double delay, TimerCallback cb) {
+  Timestamp time(AddTime(Timestamp::MonotonicNow(), delay));
+  return timer_queue_->AddTimer(std::move(cb), time, 0.0);
 }
 
-TimerId EventLoop::RunEvery(double interval, const TimerCallback& cb) {
-  Timestamp time(AddTime(Timestamp::Now(), interval));
-  return timer_queue_->AddTimer(cb, time, interval);
+TimerId EventLoop::RunEvery(double interval, TimerCallback cb) {
+  Timestamp time(AddTime(Timestamp::MonotonicNow(), interval));
+  return timer_queue_->AddTimer(std::move(cb), time, interval);
 }
 
 void EventLoop::Cancel(TimerId timerId) {
@@ -312,17 +321,17 @@ void EventLoop::HandleRead() {
 }
 
 void EventLoop::DoPendingFunctors() {
-  std::vector<Functor> functors;
   calling_pending_functors_ = true;
 
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    functors.swap(pending_functors_);
+    running_functors_.swap(pending_functors_);
   }
 
-  for (size_t i = 0; i < functors.size(); ++i) {
-    functors[i]();
+  for (size_t i = 0; i < running_functors_.size(); ++i) {
+    running_functors_[i]();
   }
+  running_functors_.clear();
 
   calling_pending_functors_ = false;
 }
@@ -23,6 +23,7 @@
 #endif
 
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/move_only_function.h"
 #include "muduo-cpp11/base/timestamp.h"
 #include "muduo-cpp11/net/callbacks.h"
 #include "muduo-cpp11/net/timer_id.h"
@@ -40,7 +41,7 @@ class TimerQueue;
 /// This is an interface class, so don't expose too much details.
 class EventLoop {
  public:
-  typedef std::function<void()> Functor;
+  typedef MoveOnlyFunction<void ()> Functor;
 
   EventLoop();
   ~EventLoop();
@@ -59,12 +60,23 @@ class EventLoop {
   void Quit();
 
   ///
-  /// Time when poll returns, usually means data arrival.
+  /// Time when poll returns, usually means data arrival. A wall clock
+  /// time derived from cached_now(), following changes of the wall clock
+  /// within a second.
   ///
   Timestamp poll_return_time() const {
     return poll_return_time_;
   }
 
+  ///
+  /// Timestamp::MonotonicNow() taken when poll returns, refreshed once per
+  /// iteration, so hot paths measuring intervals need no clock read. It
+  /// lags behind by as long as the current iteration has been running.
+  ///
+  Timestamp cached_now() const {
+    return cached_now_;
+  }
+
   /// Iteration count.
   int64_t iteration() const {
     return iteration_;
@@ -76,34 +88,36 @@ class EventLoop {
   /// If in the same loop thread, cb is run within the function.
   ///
   /// Safe to call from other threads.
-  void RunInLoop(const Functor& cb);
+  void RunInLoop(Functor cb);
 
   /// Queues callback in the loop thread.
   ///
   /// Runs after finish pooling.
   ///
   /// Safe to call from other threads.
-  void QueueInLoop(const Functor& cb);
+  void QueueInLoop(Functor cb);
 
   // timers
 
   ///
-  /// Runs callback at 'time'.
+  /// Runs callback at 'time', a wall clock time like Timestamp::Now().
+  /// Timers run on the monotonic clock, so 'time' is converted to a delay
+  /// from now; clock steps after the call do not move the timer.
   /// Safe to call from other threads.
   ///
-  TimerId RunAt(const Timestamp& time, const TimerCallback& cb);
+  TimerId RunAt(const Timestamp& time, TimerCallback cb);
 
   ///
   /// Runs callback after @c delay seconds.
   /// Safe to call from other threads.
   ///
-  TimerId RunAfter(double delay, const TimerCallback& cb);
+  TimerId RunAfter(double delay, TimerCallback cb);
 
   ///
   /// Runs callback every @c interval seconds.
   /// Safe to call from other threads.
   ///
-  TimerId RunEvery(double interval, const TimerCallback& cb);
+  TimerId RunEvery(double interval, TimerCallback cb);
 
   ///
   /// Cancels the timer.
@@ -170,6 +184,10 @@ class EventLoop {
   const pid_t thread_id_;
 
   Timestamp poll_return_time_;
+  Timestamp cached_now_;
+  // Timestamp::Now() - Timestamp::MonotonicNow(), in microseconds.
+  int64_t wall_clock_offset_;
+  Timestamp next_wall_clock_sync_;
   std::unique_ptr<Poller> poller_;
   std::unique_ptr<TimerQueue> timer_queue_;
 
@@ -193,6 +211,8 @@ class EventLoop {
 
   std::mutex mutex_;
   std::vector<Functor> pending_functors_;  // @GuardedBy mutex_
+  // Swapped with pending_functors_, both keep their capacity.
+  std::vector<Functor> running_functors_;
 
   DISABLE_COPY_AND_ASSIGN(EventLoop);
 };
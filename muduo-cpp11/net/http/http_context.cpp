@@ -0,0 +1,392 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/http/http_context.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "muduo-cpp11/net/buffer.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+namespace {
+
+bool IsSpace(const char c) {
+  return c == ' ' || c == '\t';
+}
+
+// memchr() is vectorized by the C library, the scanners below lean on it
+// instead of looking at a byte at a time.
+const char* FindChar(const char* begin, const char* end, const char c) {
+  return static_cast<const char*>(memchr(begin, c, end - begin));
+}
+
+int HexValue(const char c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+}  // namespace
+
+bool HttpContext::ParseRequest(Buffer* buf, Timestamp receive_time) {
+  if (state_ == kExpectRequestLine || state_ == kExpectHeaders) {
+    if (!ParseHead(buf, receive_time)) {
+      return false;
+    }
+  }
+
+  if (state_ == kExpectBody) {
+    // The buffer moves its bytes when it grows.
+    if (!streaming_ && buf->Peek() != base_) {
+      request_.Rebase(base_, buf->Peek());
+      base_ = buf->Peek();
+    }
+    return ParseBody(buf);
+  }
+  return true;
+}
+
+bool HttpContext::ParseHead(Buffer* buf, Timestamp receive_time) {
+  // Tolerates empty lines ahead of a request, as RFC 7230 3.5 suggests.
+  while (scanned_ == 0 && buf->ReadableBytes() >= 2 &&
+         buf->Peek()[0] == '\r' && buf->Peek()[1] == '\n') {
+    buf->Retrieve(2);
+  }
+
+  const char* begin = buf->Peek();
+  const char* end = begin + buf->ReadableBytes();
+  const char* header_end = NULL;
+  const char* p = begin + scanned_;
+  while (p < end) {
+    const char* lf = FindChar(p, end, '\n');
+    if (lf == NULL) {
+      break;
+    }
+    state_ = kExpectHeaders;
+    // An empty line ends the headers.
+    if (lf - begin >= 3 && lf[-1] == '\r' && lf[-2] == '\n') {
+      header_end = lf + 1;
+      break;
+    }
+    p = lf + 1;
+  }
+
+  if (header_end == NULL) {
+    scanned_ = end - begin;
+    return scanned_ <= kMaxHeaderSize || Fail(kBadRequest);
+  }
+
+  const char* line_end = FindChar(begin, header_end, '\n');
+  // Also when all of it came in one read.
+  if (static_cast<size_t>(header_end - begin) > kMaxHeaderSize ||
+      line_end - begin < 2 || line_end[-1] != '\r' ||
+      !ParseRequestLine(begin, line_end - 1) ||
+      !ParseHeaders(line_end + 1, header_end)) {
+    return Fail(kBadRequest);
+  }
+
+  request_.set_receivetime(receive_time);
+  base_ = begin;
+  head_length_ = header_end - begin;
+  parse_offset_ = head_length_;
+  request_length_ = head_length_;
+  return SetUpBody(buf);
+}
+
+bool HttpContext::ParseRequestLine(const char* begin, const char* end) {
+  const char* space = FindChar(begin, end, ' ');
+  if (space == NULL || !request_.set_method(begin, space)) {
+    return false;
+  }
+
+  const char* start = space + 1;
+  space = FindChar(start, end, ' ');
+  if (space == NULL || space == start) {
+    return false;
+  }
+
+  const char* question = std::find(start, space, '?');
+  request_.set_path(start, question);
+  if (question != space) {
+    request_.set_query(question, space);
+  }
+
+  start = space + 1;
+  if (end - start != 8 || memcmp(start, "HTTP/1.", 7) != 0) {
+    return false;
+  }
+
+  if (start[7] == '1') {
+    request_.set_version(HttpRequest::kHttp11);
+  } else if (start[7] == '0') {
+    request_.set_version(HttpRequest::kHttp10);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// [begin, end) holds "name: value\r\n" lines and the empty line.
+bool HttpContext::ParseHeaders(const char* begin, const char* end) {
+  const char* line = begin;
+  for (;;) {
+    const char* lf = FindChar(line, end, '\n');
+    if (lf == NULL || lf == line || lf[-1] != '\r') {
+      return false;
+    }
+
+    const char* line_end = lf - 1;
+    if (line_end == line) {
+      return true;
+    }
+
+    // A line starting with whitespace is an obsolete folded value.
+    const char* colon = FindChar(line, line_end, ':');
+    if (colon == NULL || colon == line || IsSpace(*line) || IsSpace(colon[-1])) {
+      return false;
+    }
+
+    const char* value = colon + 1;
+    const char* value_end = line_end;
+    while (value < value_end && IsSpace(*value)) {
+      ++value;
+    }
+    while (value_end > value && IsSpace(value_end[-1])) {
+      --value_end;
+    }
+
+    if (!request_.AddHeader(StringPiece(line, static_cast<int>(colon - line)),
+                            StringPiece(value, static_cast<int>(value_end - value)))) {
+      return false;
+    }
+    line = lf + 1;
+  }
+}
+
+bool HttpContext::SetUpBody(Buffer* buf) {
+  // Repeated framing headers, but for equal Content-Lengths, would let a
+  // proxy and us disagree on where the body ends, see RFC 7230 3.3.3.
+  StringPiece transfer_encoding;
+  StringPiece content_length;
+  bool has_transfer_encoding = false;
+  bool has_content_length = false;
+  for (int i = 0; i < request_.num_headers(); ++i) {
+    const HttpRequest::Header& header = request_.header(i);
+    if (EqualsIgnoreCase(header.name, "Content-Length")) {
+      if (has_content_length && header.value != content_length) {
+        return Fail(kBadRequest);
+      }
+      has_content_length = true;
+      content_length = header.value;
+    } else if (EqualsIgnoreCase(header.name, "Transfer-Encoding")) {
+      if (has_transfer_encoding) {
+        return Fail(kBadRequest);
+      }
+      has_transfer_encoding = true;
+      transfer_encoding = header.value;
+    }
+  }
+
+  if (has_transfer_encoding) {
+    // As would both.
+    if (has_content_length || !EqualsIgnoreCase(transfer_encoding, "chunked")) {
+      return Fail(kBadRequest);
+    }
+    chunked_ = true;
+    chunk_state_ = kChunkSize;
+    state_ = kExpectBody;
+  } else if (has_content_length) {
+    if (content_length.size() > 18) {
+      return Fail(kBadRequest);
+    }
+    remaining_ = 0;
+    for (int i = 0; i < content_length.size(); ++i) {
+      if (!isdigit(static_cast<unsigned char>(content_length[i]))) {
+        return Fail(kBadRequest);
+      }
+      remaining_ = remaining_ * 10 + (content_length[i] - '0');
+    }
+
+    if (max_body_size_ > 0 && remaining_ > max_body_size_) {
+      return Fail(kPayloadTooLarge);
+    }
+    state_ = remaining_ > 0 ? kExpectBody : kGotAll;
+    if (body_callback_ && remaining_ > max_buffered_body_size_) {
+      StartStreaming(buf);
+    }
+  } else {
+    state_ = kGotAll;
+  }
+  return true;
+}
+
+bool HttpContext::ParseBody(Buffer* buf) {
+  if (chunked_) {
+    return ParseChunkedBody(buf);
+  }
+
+  uint64_t available = buf->ReadableBytes() - parse_offset_;
+  size_t length = static_cast<size_t>(std::min(available, remaining_));
+  if (length > 0 && !ConsumeBody(buf, length)) {
+    return false;
+  }
+
+  remaining_ -= length;
+  if (remaining_ == 0) {
+    FinishBody(buf);
+  } else if (streaming_) {
+    buf->Retrieve(parse_offset_);
+    parse_offset_ = 0;
+  }
+  return true;
+}
+
+bool HttpContext::ParseChunkedBody(Buffer* buf) {
+  for (;;) {
+    // Streaming retrieves from the buffer, look again every round.
+    const char* p = buf->Peek() + parse_offset_;
+    const char* end = buf->Peek() + buf->ReadableBytes();
+    if (chunk_state_ == kChunkSize) {
+      const char* lf = FindChar(p, end, '\n');
+      if (lf == NULL) {
+        if (static_cast<size_t>(end - p) > kMaxChunkSizeLine) {
+          return Fail(kBadRequest);
+        }
+        break;
+      }
+
+      uint64_t size = 0;
+      const char* digit = p;
+      for (; digit < lf && isxdigit(static_cast<unsigned char>(*digit)); ++digit) {
+        if (digit - p == 15) {
+          return Fail(kBadRequest);
+        }
+        size = size * 16 + HexValue(*digit);
+      }
+      // Chunk extensions, after a ';', are ignored.
+      if (digit == p || lf[-1] != '\r' || (digit != lf - 1 && *digit != ';')) {
+        return Fail(kBadRequest);
+      }
+
+      parse_offset_ += lf + 1 - p;
+      if (size == 0) {
+        chunk_state_ = kTrailers;
+        remaining_ = 0;
+      } else {
+        chunk_state_ = kChunkData;
+        remaining_ = size;
+      }
+    } else if (chunk_state_ == kChunkData) {
+      size_t length = static_cast<size_t>(std::min(static_cast<uint64_t>(end - p), remaining_));
+      if (length == 0) {
+        break;
+      }
+      if (!ConsumeBody(buf, length)) {
+        return false;
+      }
+      remaining_ -= length;
+      if (remaining_ == 0) {
+        chunk_state_ = kChunkDataEnd;
+      }
+    } else if (chunk_state_ == kChunkDataEnd) {
+      if (end - p < 2) {
+        break;
+      }
+      if (p[0] != '\r' || p[1] != '\n') {
+        return Fail(kBadRequest);
+      }
+      parse_offset_ += 2;
+      chunk_state_ = kChunkSize;
+    } else {
+      // Trailers are skipped, remaining_ counts their bytes.
+      const char* lf = FindChar(p, end, '\n');
+      if (lf == NULL) {
+        if (remaining_ + (end - p) > kMaxHeaderSize) {
+          return Fail(kBadRequest);
+        }
+        break;
+      }
+      if (lf == p || lf[-1] != '\r') {
+        return Fail(kBadRequest);
+      }
+
+      parse_offset_ += lf + 1 - p;
+      remaining_ += lf + 1 - p;
+      if (lf == p + 1) {
+        FinishBody(buf);
+        return true;
+      }
+    }
+  }
+
+  if (streaming_) {
+    buf->Retrieve(parse_offset_);
+    parse_offset_ = 0;
+  }
+  return true;
+}
+
+bool HttpContext::ConsumeBody(Buffer* buf, size_t length) {
+  body_received_ += length;
+  if (max_body_size_ > 0 && body_received_ > max_body_size_) {
+    return Fail(kPayloadTooLarge);
+  }
+
+  if (!streaming_ && body_callback_ && body_length_ + length > max_buffered_body_size_) {
+    StartStreaming(buf);
+  }
+
+  if (streaming_) {
+    body_callback_(request_, StringPiece(buf->Peek() + parse_offset_, static_cast<int>(length)));
+  } else {
+    // Decodes in place: the bytes of a chunked body are moved down over
+    // the chunk framing, right after the bytes decoded before.
+    char* base = const_cast<char*>(buf->Peek());
+    char* to = base + head_length_ + body_length_;
+    const char* from = base + parse_offset_;
+    if (to != from) {
+      memmove(to, from, length);
+    }
+    body_length_ += length;
+  }
+  parse_offset_ += length;
+  return true;
+}
+
+void HttpContext::StartStreaming(Buffer* buf) {
+  const char* base = buf->Peek();
+  head_.assign(base, head_length_);
+  request_.Rebase(base, head_.data());
+  request_.set_body_streamed(true);
+  streaming_ = true;
+
+  if (body_length_ > 0) {
+    body_callback_(request_, StringPiece(base + head_length_, static_cast<int>(body_length_)));
+    body_length_ = 0;
+  }
+
+  buf->Retrieve(parse_offset_);
+  parse_offset_ = 0;
+  head_length_ = 0;
+}
+
+void HttpContext::FinishBody(Buffer* buf) {
+  if (streaming_) {
+    buf->Retrieve(parse_offset_);
+    request_length_ = 0;
+  } else {
+    const char* body = buf->Peek() + head_length_;
+    request_.set_body(body, body + body_length_);
+    request_length_ = parse_offset_;
+  }
+  parse_offset_ = 0;
+  state_ = kGotAll;
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
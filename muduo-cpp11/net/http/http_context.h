@@ -12,13 +12,34 @@
 #ifndef MUDUO_CPP11_NET_HTTP_HTTPCONTEXT_H_
 #define MUDUO_CPP11_NET_HTTP_HTTPCONTEXT_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/base/timestamp.h"
 #include "muduo-cpp11/net/http/http_request.h"
 
 namespace muduo_cpp11 {
 namespace net {
 
+class Buffer;
+
+/// Parses the requests of one connection. A request is parsed in place:
+/// the request line and headers are scanned once they have all arrived,
+/// and the request keeps views into the input buffer, which the caller
+/// retrieves (request_length() bytes) after handling it.
+///
+/// A body, framed by Content-Length or chunked, is kept in the buffer
+/// too, chunked ones decoded in place. With a body callback, a body
+/// growing past the buffered limit is handed to it piece by piece as it
+/// arrives instead, and the request's head is copied out of the buffer.
 class HttpContext {
  public:
+  typedef std::function<void (const HttpRequest&, const StringPiece& data)> BodyCallback;
+
   enum HttpRequestParseState {
     kExpectRequestLine,
     kExpectHeaders,
@@ -26,12 +47,44 @@ class HttpContext {
     kGotAll,
   };
 
+  enum ParseError {
+    kNoError,
+    kBadRequest,
+    kPayloadTooLarge,
+  };
+
   explicit HttpContext(const std::string& remote_addr)
-      : state_(kExpectRequestLine) {
+      : state_(kExpectRequestLine),
+        error_(kNoError),
+        scanned_(0),
+        request_length_(0),
+        base_(NULL),
+        head_length_(0),
+        parse_offset_(0),
+        chunked_(false),
+        chunk_state_(kChunkSize),
+        remaining_(0),
+        body_length_(0),
+        body_received_(0),
+        streaming_(false),
+        max_body_size_(0),
+        max_buffered_body_size_(0) {
     request_.set_remote_addr(remote_addr);
   }
 
-  // default copy-ctor, dtor and assignment are fine
+  // default copy-ctor, dtor and assignment are fine while no request is
+  // half parsed, it may view into head_.
+
+  /// 0 means unlimited.
+  void set_max_body_size(const size_t max_body_size) {
+    max_body_size_ = max_body_size;
+  }
+
+  /// Bodies longer than @max_buffered_body_size go to @cb.
+  void set_body_callback(const BodyCallback& cb, const size_t max_buffered_body_size) {
+    body_callback_ = cb;
+    max_buffered_body_size_ = max_buffered_body_size;
+  }
 
   bool ExpectRequestLine() const {
     return state_ == kExpectRequestLine;
@@ -49,18 +102,35 @@ class HttpContext {
     return state_ == kGotAll;
   }
 
-  void ReceiveRequestLine() {
-    state_ = kExpectHeaders;
+  /// Parses as much of the request at the front of @buf as has arrived,
+  /// returns false if it is malformed or too large, see error(). Bytes
+  /// already scanned are not scanned again when more arrive.
+  bool ParseRequest(Buffer* buf, Timestamp receive_time);
+
+  ParseError error() const {
+    return error_;
   }
 
-  void ReceiveHeaders() {  // FIXME
-    state_ = kGotAll;
+  /// Bytes at the front of the input buffer taken by the request.
+  size_t request_length() const {
+    return request_length_;
   }
 
   void Reset() {
     state_ = kExpectRequestLine;
-    HttpRequest dummy;
-    request_.swap(dummy);
+    error_ = kNoError;
+    scanned_ = 0;
+    request_length_ = 0;
+    base_ = NULL;
+    head_length_ = 0;
+    parse_offset_ = 0;
+    chunked_ = false;
+    chunk_state_ = kChunkSize;
+    remaining_ = 0;
+    body_length_ = 0;
+    body_received_ = 0;
+    streaming_ = false;
+    request_.Clear();
   }
 
   const HttpRequest& request() const {
@@ -72,7 +142,62 @@ class HttpContext {
   }
 
  private:
+  enum ChunkState {
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd,
+    kTrailers,
+  };
+
+  // The request line and headers must fit in this, and so must the
+  // trailers of a chunked body.
+  static const size_t kMaxHeaderSize = 64 * 1024;
+  static const size_t kMaxChunkSizeLine = 1024;
+
+  bool ParseHead(Buffer* buf, Timestamp receive_time);
+  bool ParseRequestLine(const char* begin, const char* end);
+  bool ParseHeaders(const char* begin, const char* end);
+  bool SetUpBody(Buffer* buf);
+  bool ParseBody(Buffer* buf);
+  bool ParseChunkedBody(Buffer* buf);
+  // Takes @length body bytes at parse_offset_.
+  bool ConsumeBody(Buffer* buf, size_t length);
+  void StartStreaming(Buffer* buf);
+  void FinishBody(Buffer* buf);
+
+  bool Fail(ParseError error) {
+    error_ = error;
+    return false;
+  }
+
   HttpRequestParseState state_;
+  ParseError error_;
+  // How far the header block has been searched for its end.
+  size_t scanned_;
+  size_t request_length_;
+
+  // Offsets below are from the front of the input buffer, which was at
+  // base_ when last looked at.
+  const char* base_;
+  size_t head_length_;
+  // Next byte of the body not parsed yet.
+  size_t parse_offset_;
+
+  bool chunked_;
+  ChunkState chunk_state_;
+  // Of the Content-Length, or of the current chunk.
+  uint64_t remaining_;
+  // Decoded bytes kept right after the head.
+  size_t body_length_;
+  uint64_t body_received_;
+  bool streaming_;
+  // Holds the head of a streamed request.
+  std::string head_;
+
+  size_t max_body_size_;
+  size_t max_buffered_body_size_;
+  BodyCallback body_callback_;
+
   HttpRequest request_;
 };
 
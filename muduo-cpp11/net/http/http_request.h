@@ -13,16 +13,24 @@
 #define MUDUO_CPP11_NET_HTTP_HTTPREQUEST_H_
 
 #include <assert.h>
-#include <stdio.h>
+#include <string.h>
+#include <strings.h>
 
 #include <string>
-#include <map>
 
+#include "muduo-cpp11/base/string_piece.h"
 #include "muduo-cpp11/base/timestamp.h"
 
 namespace muduo_cpp11 {
 namespace net {
 
+inline bool EqualsIgnoreCase(const StringPiece& a, const StringPiece& b) {
+  return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+/// A parsed request. The path, query, headers and body are views into the
+/// connection's input buffer, valid while the HttpCallback runs; an
+/// asynchronous handler copies what it needs later.
 class HttpRequest {
  public:
   enum Method {
@@ -33,9 +41,18 @@ class HttpRequest {
     kUnknown, kHttp10, kHttp11
   };
 
+  struct Header {
+    StringPiece name;
+    StringPiece value;
+  };
+
+  static const int kMaxHeaders = 64;
+
   HttpRequest()
       : method_(kInvalid),
-        version_(kUnknown) {
+        version_(kUnknown),
+        num_headers_(0),
+        body_streamed_(false) {
   }
 
   void set_version(Version v) {
@@ -48,16 +65,16 @@ class HttpRequest {
 
   bool set_method(const char* start, const char* end) {
     assert(method_ == kInvalid);
-    std::string m(start, end);
-    if (m == "GET") {
+    size_t length = end - start;
+    if (length == 3 && memcmp(start, "GET", 3) == 0) {
       method_ = kGet;
-    } else if (m == "POST") {
+    } else if (length == 4 && memcmp(start, "POST", 4) == 0) {
       method_ = kPost;
-    } else if (m == "HEAD") {
+    } else if (length == 4 && memcmp(start, "HEAD", 4) == 0) {
       method_ = kHead;
-    } else if (m == "PUT") {
+    } else if (length == 3 && memcmp(start, "PUT", 3) == 0) {
       method_ = kPut;
-    } else if (m == "DELETE") {
+    } else if (length == 6 && memcmp(start, "DELETE", 6) == 0) {
       method_ = kDelete;
     } else {
       method_ = kInvalid;
@@ -94,18 +111,19 @@ class HttpRequest {
   }
 
   void set_path(const char* start, const char* end) {
-    path_.assign(start, end);
+    path_.set(start, static_cast<int>(end - start));
   }
 
-  const std::string& path() const {
+  StringPiece path() const {
     return path_;
   }
 
+  /// Includes the leading '?'.
   void set_query(const char* start, const char* end) {
-    query_.assign(start, end);
+    query_.set(start, static_cast<int>(end - start));
   }
 
-  const std::string& query() const {
+  StringPiece query() const {
     return query_;
   }
 
@@ -125,49 +143,94 @@ class HttpRequest {
     return receivetime_;
   }
 
-  void AddHeader(const char* start, const char* colon, const char* end) {
-    std::string field(start, colon);
-    ++colon;
-    while (colon < end && isspace(*colon)) {
-      ++colon;
+  /// Returns false if there are kMaxHeaders already.
+  bool AddHeader(const StringPiece& name, const StringPiece& value) {
+    if (num_headers_ == kMaxHeaders) {
+      return false;
     }
-    std::string value(colon, end);
-    while (!value.empty() && isspace(value[value.size()-1])) {
-      value.resize(value.size()-1);
+    headers_[num_headers_].name = name;
+    headers_[num_headers_].value = value;
+    ++num_headers_;
+    return true;
+  }
+
+  /// Case insensitive, the first one if repeated, empty if absent.
+  StringPiece GetHeader(const StringPiece& field) const {
+    for (int i = 0; i < num_headers_; ++i) {
+      if (EqualsIgnoreCase(headers_[i].name, field)) {
+        return headers_[i].value;
+      }
     }
-    headers_[field] = value;
+    return StringPiece();
   }
 
-  std::string GetHeader(const std::string& field) const {
-    std::string result;
-    std::map<std::string, std::string>::const_iterator it = headers_.find(field);
-    if (it != headers_.end()) {
-      result = it->second;
-    }
-    return result;
+  int num_headers() const {
+    return num_headers_;
+  }
+
+  const Header& header(int i) const {
+    assert(i >= 0 && i < num_headers_);
+    return headers_[i];
+  }
+
+  void set_body(const char* start, const char* end) {
+    body_.set(start, static_cast<int>(end - start));
   }
 
-  const std::map<std::string, std::string>& headers() const {
-    return headers_;
+  /// Empty if the body was streamed to the BodyCallback.
+  StringPiece body() const {
+    return body_;
   }
 
-  void swap(HttpRequest& that) {
-    std::swap(method_, that.method_);
-    path_.swap(that.path_);
-    query_.swap(that.query_);
-    remote_addr_.swap(that.remote_addr_);
-    receivetime_.swap(that.receivetime_);
-    headers_.swap(that.headers_);
+  void set_body_streamed(bool on) {
+    body_streamed_ = on;
+  }
+
+  bool body_streamed() const {
+    return body_streamed_;
+  }
+
+  /// Points the views at a copy of the bytes they view, or at where the
+  /// buffer has moved them.
+  void Rebase(const char* from, const char* to) {
+    RebasePiece(from, to, &path_);
+    RebasePiece(from, to, &query_);
+    RebasePiece(from, to, &body_);
+    for (int i = 0; i < num_headers_; ++i) {
+      RebasePiece(from, to, &headers_[i].name);
+      RebasePiece(from, to, &headers_[i].value);
+    }
+  }
+
+  /// Forgets the request, keeps remote_addr().
+  void Clear() {
+    method_ = kInvalid;
+    version_ = kUnknown;
+    path_.clear();
+    query_.clear();
+    receivetime_ = Timestamp();
+    num_headers_ = 0;
+    body_.clear();
+    body_streamed_ = false;
   }
 
  private:
+  static void RebasePiece(const char* from, const char* to, StringPiece* piece) {
+    if (piece->data() != NULL) {
+      piece->set(to + (piece->data() - from), piece->size());
+    }
+  }
+
   Method method_;
   Version version_;
-  std::string path_;
-  std::string query_;
+  StringPiece path_;
+  StringPiece query_;
   std::string remote_addr_;
   Timestamp receivetime_;
-  std::map<std::string, std::string> headers_;
+  int num_headers_;
+  Header headers_[kMaxHeaders];
+  StringPiece body_;
+  bool body_streamed_;
 };
 
 }  // namespace net
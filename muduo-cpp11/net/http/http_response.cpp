@@ -10,7 +10,9 @@
 
 #include "muduo-cpp11/net/http/http_response.h"
 
-#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
 
 #include <string>
 
@@ -21,33 +23,150 @@ using std::string;
 namespace muduo_cpp11 {
 namespace net {
 
-void HttpResponse::AppendToBuffer(Buffer* output) const {
-  char buf[32];
-  snprintf(buf, sizeof buf, "HTTP/1.1 %d ", status_code_);
+namespace {
+
+struct StatusLine {
+  int code;
+  const char* reason;
+  const char* line;
+};
+
+const StatusLine kStatusLines[] = {
+  { 200, "OK", "HTTP/1.1 200 OK\r\n" },
+  { 206, "Partial Content", "HTTP/1.1 206 Partial Content\r\n" },
+  { 301, "Moved Permanently", "HTTP/1.1 301 Moved Permanently\r\n" },
+  { 304, "Not Modified", "HTTP/1.1 304 Not Modified\r\n" },
+  { 400, "Bad Request", "HTTP/1.1 400 Bad Request\r\n" },
+  { 403, "Forbidden", "HTTP/1.1 403 Forbidden\r\n" },
+  { 404, "Not Found", "HTTP/1.1 404 Not Found\r\n" },
+  { 405, "Method Not Allowed", "HTTP/1.1 405 Method Not Allowed\r\n" },
+  { 413, "Payload Too Large", "HTTP/1.1 413 Payload Too Large\r\n" },
+  { 416, "Range Not Satisfiable", "HTTP/1.1 416 Range Not Satisfiable\r\n" },
+};
+
+const StatusLine* FindStatusLine(const int code) {
+  for (size_t i = 0; i < sizeof kStatusLines / sizeof kStatusLines[0]; ++i) {
+    if (kStatusLines[i].code == code) {
+      return &kStatusLines[i];
+    }
+  }
+  return NULL;
+}
+
+// The Date header line, each thread formats it again once a second.
+StringPiece DateHeader() {
+  struct Cache {
+    time_t seconds;
+    int length;
+    char line[64];
+  };
+  static thread_local Cache t_cache = { -1, 0, "" };
+
+  time_t now = time(NULL);
+  if (now != t_cache.seconds) {
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    t_cache.length = static_cast<int>(strftime(t_cache.line, sizeof t_cache.line,
+                                               "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm));
+    t_cache.seconds = now;
+  }
+  return StringPiece(t_cache.line, t_cache.length);
+}
+
+char* Copy(char* to, const StringPiece& data) {
+  memcpy(to, data.data(), data.size());
+  return to + data.size();
+}
 
-  output->Append(buf);
-  output->Append(status_message_);
-  output->Append("\r\n");
+char* FormatNumber(char* to, size_t value) {
+  char digits[24];
+  char* p = digits + sizeof digits;
+  do {
+    *--p = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  return Copy(to, StringPiece(p, static_cast<int>(digits + sizeof digits - p)));
+}
+
+}  // namespace
 
-  if (!keepalive_) {
-    output->Append("Connection: close\r\n");
+void HttpResponse::AddHeader(const string& key, const string& value) {
+  for (size_t i = 0; i < headers_.size(); ++i) {
+    if (headers_[i].first == key) {
+      headers_[i].second = value;
+      return;
+    }
+  }
+  headers_.push_back(std::make_pair(key, value));
+}
+
+StringPiece HttpResponse::GetHeader(const StringPiece& key) const {
+  for (size_t i = 0; i < headers_.size(); ++i) {
+    const string& name = headers_[i].first;
+    if (name.size() == static_cast<size_t>(key.size()) &&
+        strncasecmp(name.data(), key.data(), name.size()) == 0) {
+      return headers_[i].second;
+    }
+  }
+  return StringPiece();
+}
+
+void HttpResponse::AppendHeadToBuffer(Buffer* output) const {
+  const StatusLine* status = FindStatusLine(status_code_);
+  bool preformatted = status != NULL &&
+                      (status_message_.empty() || status_message_ == status->reason);
+  StringPiece date = DateHeader();
+
+  // Room for all of it, so it is written without further checks.
+  size_t length = 32 + status_message_.size() + date.size() + 64 + 2;
+  for (size_t i = 0; i < headers_.size(); ++i) {
+    length += headers_[i].first.size() + headers_[i].second.size() + 4;
+  }
+  if (header_block_) {
+    length += header_block_->size();
+  }
+  output->EnsureWritableBytes(length);
+
+  char* const begin = output->BeginWrite();
+  char* p = begin;
+  if (preformatted) {
+    p = Copy(p, status->line);
   } else {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->Append(buf);
-    output->Append("Connection: Keep-Alive\r\n");
+    p = Copy(p, "HTTP/1.1 ");
+    p = FormatNumber(p, status_code_);
+    *p++ = ' ';
+    p = Copy(p, status_message_);
+    p = Copy(p, "\r\n");
   }
 
-  for (std::map<string, string>::const_iterator it = headers_.begin();
-       it != headers_.end();
-       ++it) {
-    output->Append(it->first);
-    output->Append(": ");
-    output->Append(it->second);
-    output->Append("\r\n");
+  p = Copy(p, date);
+  // A 304 has no body, its Content-Length would be that of a 200.
+  if (status_code_ != k304NotModified) {
+    p = Copy(p, "Content-Length: ");
+    p = FormatNumber(p, file_fd_ >= 0 ? file_length_ : body().size());
+    p = Copy(p, "\r\n");
   }
+  p = Copy(p, keepalive_ ? "Connection: Keep-Alive\r\n" : "Connection: close\r\n");
 
-  output->Append("\r\n");
-  output->Append(body_);
+  for (size_t i = 0; i < headers_.size(); ++i) {
+    p = Copy(p, headers_[i].first);
+    p = Copy(p, ": ");
+    p = Copy(p, headers_[i].second);
+    p = Copy(p, "\r\n");
+  }
+  if (header_block_) {
+    p = Copy(p, *header_block_);
+  }
+
+  p = Copy(p, "\r\n");
+  output->HasWritten(p - begin);
+}
+
+void HttpResponse::AppendToBuffer(Buffer* output) const {
+  AppendHeadToBuffer(output);
+  if (!body_omitted_) {
+    output->Append(body());
+  }
 }
 
 }  // namespace net
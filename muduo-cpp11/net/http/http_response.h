@@ -12,32 +12,63 @@
 #ifndef MUDUO_CPP11_NET_HTTP_HTTPRESPONSE_H_
 #define MUDUO_CPP11_NET_HTTP_HTTPRESPONSE_H_
 
-#include <map>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "muduo-cpp11/base/string_piece.h"
 
 namespace muduo_cpp11 {
 namespace net {
 
 class Buffer;
 
+/// Serialized straight into the output buffer: the status lines of the
+/// codes below are preformatted, and the Date header is formatted once a
+/// second by each loop thread.
+///
+/// Headers common to many responses can be shared as one preformatted
+/// block, and so can a large body, see set_header_block() and
+/// set_shared_body().
 class HttpResponse {
  public:
   enum HttpStatusCode {
     kUnknown,
     k200Ok = 200,
+    k206PartialContent = 206,
     k301MovedPermanently = 301,
+    k304NotModified = 304,
     k400BadRequest = 400,
+    k403Forbidden = 403,
     k404NotFound = 404,
+    k405MethodNotAllowed = 405,
+    k413PayloadTooLarge = 413,
+    k416RangeNotSatisfiable = 416,
   };
 
   explicit HttpResponse(bool keepalive)
       : status_code_(kUnknown),
-        keepalive_(keepalive) {
+        keepalive_(keepalive),
+        body_omitted_(false),
+        file_fd_(-1),
+        file_offset_(0),
+        file_length_(0) {
   }
 
   void set_status_code(HttpStatusCode code) {
     status_code_ = code;
   }
 
+  HttpStatusCode status_code() const {
+    return status_code_;
+  }
+
+  /// May be left empty for the codes above, their standard reason phrase
+  /// is used then.
   void set_status_message(const std::string& message) {
     status_message_ = message;
   }
@@ -54,24 +85,100 @@ class HttpResponse {
     AddHeader("Content-Type", content_type);
   }
 
-  // FIXME: replace std::string with StringPiece
-  void AddHeader(const std::string& key, const std::string& value) {
-    headers_[key] = value;
+  /// Replaces a header of the same name added before.
+  void AddHeader(const std::string& key, const std::string& value);
+
+  /// Of the headers added by AddHeader(), case-insensitive; empty if not
+  /// found.
+  StringPiece GetHeader(const StringPiece& key) const;
+
+  /// @block holds whole header lines, each ending with "\r\n", e.g.
+  ///
+  ///   "Server: muduo\r\nContent-Type: text/plain\r\n"
+  ///
+  /// It is copied out as it is, after the headers added one by one.
+  void set_header_block(const std::shared_ptr<const std::string>& block) {
+    header_block_ = block;
   }
 
   void set_body(const std::string& body) {
     body_ = body;
+    shared_body_.reset();
+  }
+
+  void set_body(std::string&& body) {
+    body_ = std::move(body);
+    shared_body_.reset();
+  }
+
+  /// Uses @body without copying it, e.g. the same page served again and
+  /// again.
+  void set_shared_body(const std::shared_ptr<const std::string>& body) {
+    shared_body_ = body;
+    body_.clear();
+  }
+
+  /// The body is @length bytes of the file @fd from @offset, sent with
+  /// sendfile(2) by HttpServer; AppendToBuffer() leaves it out. @owner is
+  /// held until it has been sent, see TcpConnection::SendFile().
+  void set_file_body(int fd,
+                     int64_t offset,
+                     size_t length,
+                     const std::shared_ptr<void>& owner) {
+    file_fd_ = fd;
+    file_offset_ = offset;
+    file_length_ = length;
+    file_owner_ = owner;
+  }
+
+  /// Headers only, e.g. to answer HEAD; the Content-Length still tells
+  /// the length of the body left out.
+  void set_body_omitted(bool on) {
+    body_omitted_ = on;
+  }
+
+  bool body_omitted() const {
+    return body_omitted_;
+  }
+
+  int file_fd() const {
+    return file_fd_;
+  }
+
+  int64_t file_offset() const {
+    return file_offset_;
+  }
+
+  size_t file_length() const {
+    return file_length_;
+  }
+
+  const std::shared_ptr<void>& file_owner() const {
+    return file_owner_;
+  }
+
+  StringPiece body() const {
+    return shared_body_ ? StringPiece(*shared_body_) : StringPiece(body_);
   }
 
+  /// Appends the status line and the headers.
+  void AppendHeadToBuffer(Buffer* output) const;
   void AppendToBuffer(Buffer* output) const;
 
  private:
-  std::map<std::string, std::string> headers_;
+  std::vector<std::pair<std::string, std::string>> headers_;
+  std::shared_ptr<const std::string> header_block_;
   HttpStatusCode status_code_;
   // FIXME: add http version
   std::string status_message_;
   bool keepalive_;
   std::string body_;
+  std::shared_ptr<const std::string> shared_body_;
+  bool body_omitted_;
+  int file_fd_;
+  int64_t file_offset_;
+  size_t file_length_;
+  std::shared_ptr<void> file_owner_;
 };
 
 }  // namespace net
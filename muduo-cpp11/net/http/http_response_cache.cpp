@@ -0,0 +1,375 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/http/http_response_cache.h"
+
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/net/buffer.h"
+#include "muduo-cpp11/net/event_loop.h"
+#include "muduo-cpp11/net/http/http_request.h"
+#include "muduo-cpp11/net/http/http_response.h"
+
+using std::string;
+
+namespace muduo_cpp11 {
+namespace net {
+
+namespace {
+
+const char kKeepAliveLine[] = "Connection: Keep-Alive\r\n";
+const char kCloseLine[] = "Connection: close\r\n";
+
+std::atomic<uint64_t> g_next_cache_id(1);
+
+struct CacheControl {
+  CacheControl()
+      : no_store(false),
+        no_cache(false),
+        is_private(false),
+        max_age(-1),
+        s_maxage(-1) {
+  }
+
+  bool no_store;
+  bool no_cache;
+  bool is_private;
+  int64_t max_age;
+  int64_t s_maxage;
+};
+
+bool StartsWithIgnoreCase(const StringPiece& s, const StringPiece& prefix) {
+  return s.size() >= prefix.size() &&
+         strncasecmp(s.data(), prefix.data(), prefix.size()) == 0;
+}
+
+int64_t ParseSeconds(StringPiece value) {
+  if (value.empty() || value.size() > 18) {
+    return -1;
+  }
+  int64_t seconds = 0;
+  for (int i = 0; i < value.size(); ++i) {
+    if (value[i] < '0' || value[i] > '9') {
+      return -1;
+    }
+    seconds = seconds * 10 + (value[i] - '0');
+  }
+  return seconds;
+}
+
+// Takes the next element of the comma separated @list, trimmed.
+StringPiece NextListElement(StringPiece* list) {
+  const char* comma = static_cast<const char*>(memchr(list->data(), ',', list->size()));
+  int length = comma != NULL ? static_cast<int>(comma - list->data()) : list->size();
+  StringPiece element(list->data(), length);
+  list->remove_prefix(comma != NULL ? length + 1 : length);
+
+  while (!element.empty() && (element[0] == ' ' || element[0] == '\t')) {
+    element.remove_prefix(1);
+  }
+  while (!element.empty() &&
+         (element[element.size() - 1] == ' ' || element[element.size() - 1] == '\t')) {
+    element.remove_suffix(1);
+  }
+  return element;
+}
+
+CacheControl ParseCacheControl(StringPiece header) {
+  CacheControl result;
+  while (!header.empty()) {
+    StringPiece directive(NextListElement(&header));
+    if (EqualsIgnoreCase(directive, "no-store")) {
+      result.no_store = true;
+    } else if (StartsWithIgnoreCase(directive, "no-cache")) {
+      result.no_cache = true;
+    } else if (StartsWithIgnoreCase(directive, "private")) {
+      result.is_private = true;
+    } else if (StartsWithIgnoreCase(directive, "max-age=")) {
+      directive.remove_prefix(8);
+      result.max_age = ParseSeconds(directive);
+    } else if (StartsWithIgnoreCase(directive, "s-maxage=")) {
+      directive.remove_prefix(9);
+      result.s_maxage = ParseSeconds(directive);
+    }
+  }
+  return result;
+}
+
+// Whether the response selected by the @vary request headers is the one
+// of all requests with the same @key_headers.
+bool VariesOnKeyHeaders(StringPiece vary, const std::vector<string>& key_headers) {
+  while (!vary.empty()) {
+    StringPiece name(NextListElement(&vary));
+    if (name.empty()) {
+      continue;
+    }
+    size_t i = 0;
+    while (i < key_headers.size() && !EqualsIgnoreCase(name, key_headers[i])) {
+      ++i;
+    }
+    // Also "*", varying on more than the request headers.
+    if (i == key_headers.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsCacheableStatus(const HttpResponse::HttpStatusCode code) {
+  return code == HttpResponse::k200Ok || code == 204 ||
+         code == HttpResponse::k301MovedPermanently ||
+         code == HttpResponse::k404NotFound || code == 410;
+}
+
+}  // namespace
+
+void HttpResponseCache::Entry::AppendToBuffer(Buffer* output, bool keepalive) const {
+  if (keepalive) {
+    output->Append(data);
+  } else {
+    size_t after = connection_offset + sizeof kKeepAliveLine - 1;
+    output->Append(data.data(), connection_offset);
+    output->Append(kCloseLine, sizeof kCloseLine - 1);
+    output->Append(data.data() + after, data.size() - after);
+  }
+}
+
+// The cache of one loop, most recently used first.
+class HttpResponseCache::Shard {
+ public:
+  explicit Shard(EventLoop* event_loop)
+      : loop(event_loop),
+        next_token(0) {
+  }
+
+  struct Item {
+    EntryPtr entry;
+    std::list<string>::iterator position;
+  };
+
+  // A response being made, with the requests waiting for it.
+  struct Pending {
+    uint64_t token;
+    Timestamp deadline;
+    bool timer_queued;
+    std::vector<Waiter> waiters;
+  };
+
+  EventLoop* const loop;
+  std::list<string> lru;
+  std::unordered_map<string, Item> items;
+  std::unordered_map<string, Pending> pending;
+  uint64_t next_token;
+};
+
+HttpResponseCache::HttpResponseCache()
+    : id_(g_next_cache_id++),
+      default_ttl_seconds_(0),
+      wait_timeout_seconds_(5),
+      max_entries_(10000),
+      max_entry_size_(1024 * 1024) {
+}
+
+HttpResponseCache::~HttpResponseCache() {
+}
+
+bool HttpResponseCache::MakeKey(const HttpRequest& req, string* key) const {
+  if ((req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead) ||
+      !req.body().empty() || req.body_streamed() ||
+      !req.GetHeader("Authorization").empty()) {
+    return false;
+  }
+
+  CacheControl cache_control = ParseCacheControl(req.GetHeader("Cache-Control"));
+  if (cache_control.no_store || cache_control.no_cache || cache_control.max_age == 0 ||
+      EqualsIgnoreCase(req.GetHeader("Pragma"), "no-cache")) {
+    return false;
+  }
+
+  key->assign(req.method_string());
+  key->push_back(' ');
+  key->append(req.path().data(), req.path().size());
+  key->append(req.query().data(), req.query().size());
+  for (size_t i = 0; i < key_headers_.size(); ++i) {
+    StringPiece value = req.GetHeader(key_headers_[i]);
+    key->push_back('\n');
+    key->append(value.data(), value.size());
+  }
+  return true;
+}
+
+HttpResponseCache::LookupResult HttpResponseCache::Lookup(EventLoop* loop,
+                                                          const string& key,
+                                                          EntryPtr* entry,
+                                                          uint64_t* token) {
+  Shard* shard = GetShard(loop);
+  Timestamp now = loop->cached_now();
+  std::unordered_map<string, Shard::Item>::iterator found = shard->items.find(key);
+  if (found != shard->items.end()) {
+    if (now < found->second.entry->expires) {
+      shard->lru.splice(shard->lru.begin(), shard->lru, found->second.position);
+      *entry = found->second.entry;
+      return kHit;
+    }
+    shard->lru.erase(found->second.position);
+    shard->items.erase(found);
+  }
+
+  // The one who misses first makes the response, the others wait, unless
+  // it is overdue.
+  std::unordered_map<string, Shard::Pending>::iterator pending = shard->pending.find(key);
+  if (pending != shard->pending.end()) {
+    if (now < pending->second.deadline) {
+      return kPending;
+    }
+    Abandon(loop, key, pending->second.token);
+  }
+
+  Shard::Pending& made = shard->pending[key];
+  made.token = ++shard->next_token;
+  made.deadline = AddTime(now, wait_timeout_seconds_);
+  made.timer_queued = false;
+  *token = made.token;
+  return kMiss;
+}
+
+void HttpResponseCache::Wait(EventLoop* loop, const string& key, const Waiter& waiter) {
+  Shard* shard = GetShard(loop);
+  std::unordered_map<string, Shard::Pending>::iterator pending = shard->pending.find(key);
+  assert(pending != shard->pending.end());
+  pending->second.waiters.push_back(waiter);
+
+  // Only keys with waiters get a timer, a lone miss is taken over by the
+  // next one once overdue.
+  if (!pending->second.timer_queued) {
+    pending->second.timer_queued = true;
+    loop->RunAfter(TimeDifference(pending->second.deadline, loop->cached_now()),
+                   std::bind(&HttpResponseCache::Abandon, this, loop, key, pending->second.token));
+  }
+}
+
+void HttpResponseCache::Fill(EventLoop* loop, const string& key, const HttpResponse& response) {
+  Shard* shard = GetShard(loop);
+  EntryPtr entry(MakeEntry(response, loop->cached_now()));
+  if (entry && max_entries_ > 0) {
+    std::unordered_map<string, Shard::Item>::iterator found = shard->items.find(key);
+    if (found != shard->items.end()) {
+      shard->lru.erase(found->second.position);
+      shard->items.erase(found);
+    }
+
+    shard->lru.push_front(key);
+    Shard::Item& item = shard->items[key];
+    item.entry = entry;
+    item.position = shard->lru.begin();
+    if (shard->items.size() > max_entries_) {
+      shard->items.erase(shard->lru.back());
+      shard->lru.pop_back();
+    }
+  }
+
+  // Also when overdue and made again meanwhile, any response will do.
+  // Waiters may come back for the same key.
+  std::vector<Waiter> waiters;
+  std::unordered_map<string, Shard::Pending>::iterator pending = shard->pending.find(key);
+  if (pending != shard->pending.end()) {
+    waiters.swap(pending->second.waiters);
+    shard->pending.erase(pending);
+  }
+  for (size_t i = 0; i < waiters.size(); ++i) {
+    waiters[i](entry);
+  }
+}
+
+void HttpResponseCache::Abandon(EventLoop* loop, const string& key, const uint64_t token) {
+  Shard* shard = GetShard(loop);
+  std::vector<Waiter> waiters;
+  std::unordered_map<string, Shard::Pending>::iterator pending = shard->pending.find(key);
+  if (pending == shard->pending.end() || pending->second.token != token) {
+    return;
+  }
+  waiters.swap(pending->second.waiters);
+  shard->pending.erase(pending);
+
+  for (size_t i = 0; i < waiters.size(); ++i) {
+    waiters[i](EntryPtr());
+  }
+}
+
+HttpResponseCache::Shard* HttpResponseCache::GetShard(EventLoop* loop) {
+  // Not the HttpResponseCache pointer, a new one may reuse the address of
+  // a destroyed one.
+  struct LastShard {
+    uint64_t owner_id;
+    Shard* shard;
+  };
+  static thread_local LastShard t_last = { 0, NULL };
+
+  if (t_last.owner_id == id_ && t_last.shard->loop == loop) {
+    return t_last.shard;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Shard* shard = NULL;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (shards_[i]->loop == loop) {
+      shard = shards_[i].get();
+      break;
+    }
+  }
+
+  if (shard == NULL) {
+    shards_.emplace_back(new Shard(loop));
+    shard = shards_.back().get();
+  }
+
+  t_last.owner_id = id_;
+  t_last.shard = shard;
+  return shard;
+}
+
+HttpResponseCache::EntryPtr HttpResponseCache::MakeEntry(const HttpResponse& response,
+                                                         Timestamp now) const {
+  if (!IsCacheableStatus(response.status_code()) || !response.keepalive() ||
+      response.file_fd() >= 0 || !response.GetHeader("Set-Cookie").empty() ||
+      static_cast<size_t>(response.body().size()) > max_entry_size_) {
+    return EntryPtr();
+  }
+
+  CacheControl cache_control = ParseCacheControl(response.GetHeader("Cache-Control"));
+  if (cache_control.no_store || cache_control.no_cache || cache_control.is_private ||
+      !VariesOnKeyHeaders(response.GetHeader("Vary"), key_headers_)) {
+    return EntryPtr();
+  }
+  double ttl = cache_control.s_maxage >= 0 ? static_cast<double>(cache_control.s_maxage)
+               : cache_control.max_age >= 0 ? static_cast<double>(cache_control.max_age)
+               : default_ttl_seconds_;
+  if (ttl <= 0) {
+    return EntryPtr();
+  }
+
+  Buffer buf;
+  response.AppendToBuffer(&buf);
+  Entry* entry = new Entry;
+  EntryPtr holder(entry);
+  entry->data.assign(buf.Peek(), buf.ReadableBytes());
+  // The first one, headers added later come after it.
+  entry->connection_offset = entry->data.find(kKeepAliveLine);
+  assert(entry->connection_offset != string::npos);
+  entry->expires = AddTime(now, ttl);
+  return holder;
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
@@ -0,0 +1,152 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_CPP11_NET_HTTP_HTTPRESPONSECACHE_H_
+#define MUDUO_CPP11_NET_HTTP_HTTPRESPONSECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/timestamp.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+class Buffer;
+class EventLoop;
+class HttpRequest;
+class HttpResponse;
+
+///
+/// Keeps the responses of an HttpServer, see
+/// HttpServer::set_response_cache(), and serves them again without
+/// running the HttpCallback:
+///
+///   HttpResponseCache cache;
+///   cache.AddKeyHeader("Accept-Encoding");
+///   server.set_response_cache(&cache);
+///
+/// Responses are keyed by method, path, query and the values of the key
+/// headers. A response is stored serialized, so a hit is a single append
+/// to the output; its Date stays that of the original, as from any cache.
+///
+/// Only GET and HEAD requests without Authorization are looked up, and
+/// neither those asking for no-cache or max-age=0. Stored are responses
+/// with status 200, 204, 301, 404 or 410 and no Set-Cookie or file body,
+/// for the max-age (or s-maxage) of their Cache-Control, added with
+/// AddHeader(), or the default TTL; never those marked no-store, no-cache
+/// or private, nor those whose Vary is "*" or names a header other than
+/// the key headers.
+///
+/// Requests missing the same key while its response is being made wait
+/// for it instead of running the handler too; should the response turn
+/// out not cacheable, not come within the wait timeout, or its done
+/// callback be dropped uncalled, they run the handler after all.
+///
+/// Each loop has a cache of its own, used without locking. Must outlive
+/// the servers using it, and their loops' timers.
+class HttpResponseCache {
+ public:
+  HttpResponseCache();
+  ~HttpResponseCache();
+
+  /// For responses without max-age, 0 by default, i.e. only those with
+  /// one are stored.
+  void set_default_ttl(const double seconds) {
+    default_ttl_seconds_ = seconds;
+  }
+
+  /// Responses kept by each loop, 10000 by default.
+  void set_max_entries(const size_t max_entries) {
+    max_entries_ = max_entries;
+  }
+
+  /// How long requests wait for a response being made, 5 seconds by
+  /// default. Past it they run the handler themselves, and the next miss
+  /// makes the response again.
+  void set_wait_timeout(const double seconds) {
+    wait_timeout_seconds_ = seconds;
+  }
+
+  /// Larger responses are not stored, 1MB by default.
+  void set_max_entry_size(const size_t max_size) {
+    max_entry_size_ = max_size;
+  }
+
+  /// A request header which selects between responses, e.g.
+  /// Accept-Encoding. Not thread safe, call it before starting the server.
+  void AddKeyHeader(const std::string& name) {
+    key_headers_.push_back(name);
+  }
+
+ private:
+  friend class HttpServer;
+
+  /// A response serialized with "Connection: Keep-Alive".
+  struct Entry {
+    std::string data;
+    size_t connection_offset;
+    Timestamp expires;  // of EventLoop::cached_now()
+
+    void AppendToBuffer(Buffer* output, bool keepalive) const;
+  };
+
+  typedef std::shared_ptr<const Entry> EntryPtr;
+  /// Gets the response made for the key, NULL if it is not cacheable.
+  typedef std::function<void (const EntryPtr&)> Waiter;
+
+  enum LookupResult {
+    kHit,
+    // Nobody makes this response, the caller does and Fill()s it.
+    kMiss,
+    // It is being made, the caller should Wait() for it.
+    kPending,
+  };
+
+  class Shard;
+
+  // Methods below must be called in the loop thread.
+
+  // False if @req must not be served from the cache.
+  bool MakeKey(const HttpRequest& req, std::string* key) const;
+  // On kMiss, @token identifies the caller as the one making the response.
+  LookupResult Lookup(EventLoop* loop, const std::string& key, EntryPtr* entry, uint64_t* token);
+  void Wait(EventLoop* loop, const std::string& key, const Waiter& waiter);
+  // Stores @response if cacheable, and hands it to the waiters.
+  void Fill(EventLoop* loop, const std::string& key, const HttpResponse& response);
+  // The response of @token will not come, or is overdue: lets the waiters
+  // run the handler.
+  void Abandon(EventLoop* loop, const std::string& key, uint64_t token);
+
+  Shard* GetShard(EventLoop* loop);
+  EntryPtr MakeEntry(const HttpResponse& response, Timestamp now) const;
+
+ private:
+  const uint64_t id_;
+  double default_ttl_seconds_;
+  double wait_timeout_seconds_;
+  size_t max_entries_;
+  size_t max_entry_size_;
+  std::vector<std::string> key_headers_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Shard>> shards_;  // @GuardedBy mutex_
+
+  DISABLE_COPY_AND_ASSIGN(HttpResponseCache);
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_HTTP_HTTPRESPONSECACHE_H_
@@ -10,9 +10,13 @@
 
 #include "muduo-cpp11/net/http/http_server.h"
 
+#include <assert.h>
+
+#include <deque>
 #include <string>
 
 #include "muduo-cpp11/base/logging.h"
+#include "muduo-cpp11/net/event_loop.h"
 #include "muduo-cpp11/net/http/http_context.h"
 #include "muduo-cpp11/net/http/http_request.h"
 #include "muduo-cpp11/net/http/http_response.h"
@@ -23,81 +27,6 @@ namespace muduo_cpp11 {
 namespace net {
 namespace detail {
 
-// FIXME: move to HttpContext class
-bool ProcessRequestLine(const char* begin, const char* end, HttpContext* context) {
-  bool succeed = false;
-  const char* start = begin;
-  const char* space = std::find(start, end, ' ');
-  HttpRequest& request = context->request();
-  if (space != end && request.set_method(start, space)) {
-    start = space + 1;
-    space = std::find(start, end, ' ');
-    if (space != end) {
-      const char* question = std::find(start, space, '?');
-      if (question != space) {
-        request.set_path(start, question);
-        request.set_query(question, space);
-      } else {
-        request.set_path(start, space);
-      }
-      start = space + 1;
-      succeed = (end - start == 8) && std::equal(start, end - 1, "HTTP/1.");
-      if (succeed) {
-        if (*(end - 1) == '1') {
-          request.set_version(HttpRequest::kHttp11);
-        } else if (*(end - 1) == '0') {
-          request.set_version(HttpRequest::kHttp10);
-        } else {
-          succeed = false;
-        }
-      }
-    }
-  }
-  return succeed;
-}
-
-// FIXME: move to HttpContext class
-// return false if any error
-bool ParseRequest(Buffer* buf, HttpContext* context, Timestamp receivetime) {
-  bool ok = true;
-  bool has_more = true;
-  while (has_more) {
-    if (context->ExpectRequestLine()) {
-      const char* crlf = buf->FindCRLF();
-      if (crlf) {
-        ok = ProcessRequestLine(buf->Peek(), crlf, context);
-        if (ok) {
-          context->request().set_receivetime(receivetime);
-          buf->RetrieveUntil(crlf + 2);
-          context->ReceiveRequestLine();
-        } else {
-          has_more = false;
-        }
-      } else {
-        has_more = false;
-      }
-    } else if (context->ExpectHeaders()) {
-      const char* crlf = buf->FindCRLF();
-      if (crlf) {
-        const char* colon = std::find(buf->Peek(), crlf, ':');
-        if (colon != crlf) {
-          context->request().AddHeader(buf->Peek(), colon, crlf);
-        } else {
-          // empty line, end of header
-          context->ReceiveHeaders();
-          has_more = !context->GotAll();
-        }
-        buf->RetrieveUntil(crlf + 2);
-      } else {
-        has_more = false;
-      }
-    } else if (context->ExpectBody()) {
-      // FIXME:
-    }
-  }
-  return ok;
-}
-
 void DefaultHttpCallback(const HttpRequest&,
                          const HttpServer::RequestDoneCallback& done,
                          HttpResponse* resp) {
@@ -109,12 +38,106 @@ void DefaultHttpCallback(const HttpRequest&,
 
 }  // namespace detail
 
+namespace {
+
+// A connection stops reading while this many of its requests wait for
+// their responses.
+const size_t kMaxPendingResponses = 64;
+
+// Larger bodies are not copied into the batch, they are sent on their own
+// right after it.
+const size_t kMinBodyToSendAlone = 64 * 1024;
+
+}  // namespace
+
+struct HttpServer::PendingResponse {
+  explicit PendingResponse(bool keepalive)
+      : response(keepalive),
+        done(false) {
+  }
+
+  HttpResponse response;
+  bool done;
+  // Served from the HttpResponseCache instead of response.
+  HttpResponseCache::EntryPtr cached;
+};
+
+// A request kept for the HttpCallback, with the bytes it views into.
+struct HttpServer::SavedRequest {
+  SavedRequest(const HttpRequest& req, const StringPiece& raw_bytes)
+      : raw(raw_bytes.as_string()),
+        request(req) {
+    request.Rebase(raw_bytes.data(), raw.data());
+  }
+
+  const string raw;
+  HttpRequest request;
+};
+
+// The response of a cache miss being made. Abandons it in the cache if
+// the done callback holding this is dropped without being called.
+struct HttpServer::CacheFill {
+  CacheFill(HttpResponseCache* response_cache,
+            EventLoop* event_loop,
+            const string& cache_key,
+            const uint64_t fill_token)
+      : cache(response_cache),
+        loop(event_loop),
+        key(cache_key),
+        token(fill_token),
+        done(false) {
+  }
+
+  ~CacheFill() {
+    if (!done) {
+      loop->RunInLoop(std::bind(&HttpResponseCache::Abandon, cache, loop, key, token));
+    }
+  }
+
+  HttpResponseCache* const cache;
+  EventLoop* const loop;
+  const string key;
+  const uint64_t token;
+  bool done;
+};
+
+// Kept in the context of a TcpConnection, only touched in its loop.
+struct HttpServer::Connection {
+  explicit Connection(const string& remote_addr)
+      : context(remote_addr),
+        first_sequence(0),
+        batching(false),
+        closing(false),
+        shutdown(false),
+        paused(false) {
+  }
+
+  HttpContext context;
+  // In request order, the front one is request first_sequence. A deque
+  // keeps the responses in place while others are added and removed.
+  std::deque<PendingResponse> pending;
+  uint64_t first_sequence;
+  // Set while handling the requests of one read, the responses then
+  // gather in output and go out together.
+  bool batching;
+  // No more requests are handled.
+  bool closing;
+  // A response closing the connection has been sent, later ones are not.
+  bool shutdown;
+  // Reading was stopped by kMaxPendingResponses.
+  bool paused;
+  Buffer output;
+};
+
 HttpServer::HttpServer(EventLoop* loop,
                        const InetAddress& listen_addr,
                        const string& name,
                        TcpServer::Option option)
     : server_(loop, listen_addr, name, option),
-      http_callback_(detail::DefaultHttpCallback) {
+      http_callback_(detail::DefaultHttpCallback),
+      max_body_size_(1024 * 1024),
+      max_buffered_body_size_(0),
+      response_cache_(NULL) {
   server_.set_connection_callback(std::bind(&HttpServer::OnConnection,
                                             this,
                                             std::placeholders::_1));
@@ -136,46 +159,221 @@ void HttpServer::Start() {
 
 void HttpServer::OnConnection(const TcpConnectionPtr& conn) {
   if (conn->connected()) {
-    conn->set_context(HttpContext(conn->peer_address().ToIp()));
+    Connection connection(conn->peer_address().ToIp());
+    connection.context.set_max_body_size(max_body_size_);
+    if (body_callback_) {
+      connection.context.set_body_callback(body_callback_, max_buffered_body_size_);
+    }
+    conn->set_context(connection);
   }
 }
 
 void HttpServer::OnMessage(const TcpConnectionPtr& conn,
                            Buffer* buf,
                            Timestamp receive_time) {
-  HttpContext* context = boost::any_cast<HttpContext>(conn->mutable_context());
+  Connection* connection = boost::any_cast<Connection>(conn->mutable_context());
+  HandleRequests(conn, connection, buf, receive_time);
+}
 
-  if (!detail::ParseRequest(buf, context, receive_time)) {
-    conn->Send("HTTP/1.1 400 Bad Request\r\n\r\n");
-    conn->Shutdown();
-  }
+void HttpServer::HandleRequests(const TcpConnectionPtr& conn,
+                                Connection* connection,
+                                Buffer* buf,
+                                Timestamp receive_time) {
+  HttpContext* context = &connection->context;
+  connection->batching = true;
+  while (!connection->closing && connection->pending.size() < kMaxPendingResponses) {
+    if (!context->ParseRequest(buf, receive_time)) {
+      // Answered after the requests ahead of it.
+      connection->pending.emplace_back(false);
+      PendingResponse* pending = &connection->pending.back();
+      if (context->error() == HttpContext::kPayloadTooLarge) {
+        pending->response.set_status_code(HttpResponse::k413PayloadTooLarge);
+        pending->response.set_status_message("Payload Too Large");
+      } else {
+        pending->response.set_status_code(HttpResponse::k400BadRequest);
+        pending->response.set_status_message("Bad Request");
+      }
+      pending->done = true;
+      connection->closing = true;
+      break;
+    }
+
+    if (!context->GotAll()) {
+      break;
+    }
 
-  if (context->GotAll()) {
-    OnRequest(conn, context->request());
+    OnRequest(conn, connection, context->request(),
+              StringPiece(buf->Peek(), static_cast<int>(context->request_length())));
+    // The request views into buf until here.
+    buf->Retrieve(context->request_length());
     context->Reset();
   }
+  connection->batching = false;
+
+  if (connection->closing) {
+    buf->RetrieveAll();
+  }
+
+  bool pause = !connection->closing && connection->pending.size() >= kMaxPendingResponses;
+  if (pause != connection->paused) {
+    connection->paused = pause;
+    if (pause) {
+      conn->StopRead();
+    } else {
+      conn->StartRead();
+    }
+  }
+
+  Flush(conn, connection);
 }
 
 void HttpServer::OnRequest(const TcpConnectionPtr& conn,
-                           const HttpRequest& req) {
-  const string& connection = req.GetHeader("Connection");
-  bool close = (connection == "close") ||
+                           Connection* connection,
+                           const HttpRequest& req,
+                           const StringPiece& raw) {
+  StringPiece header = req.GetHeader("Connection");
+  bool close = EqualsIgnoreCase(header, "close") ||
                (req.version() == HttpRequest::kHttp10 &&
-                connection != "Keep-Alive");
-  HttpResponse response(!close);
+                !EqualsIgnoreCase(header, "Keep-Alive"));
+  if (close) {
+    connection->closing = true;
+  }
+
+  connection->pending.emplace_back(!close);
+  PendingResponse* pending = &connection->pending.back();
+  uint64_t sequence = connection->first_sequence + connection->pending.size() - 1;
+
+  string key;
+  if (response_cache_ != NULL && response_cache_->MakeKey(req, &key)) {
+    HttpResponseCache::EntryPtr entry;
+    uint64_t token = 0;
+    switch (response_cache_->Lookup(conn->GetLoop(), key, &entry, &token)) {
+      case HttpResponseCache::kHit:
+        pending->cached = entry;
+        pending->done = true;
+        Flush(conn, connection);
+        return;
+      case HttpResponseCache::kPending:
+        response_cache_->Wait(conn->GetLoop(), key,
+                              std::bind(&HttpServer::CacheWaitDone, this, conn, sequence,
+                                        std::make_shared<SavedRequest>(req, raw),
+                                        std::placeholders::_1));
+        return;
+      case HttpResponseCache::kMiss:
+        http_callback_(req,
+                       std::bind(&HttpServer::CacheFillDone, this, conn, sequence,
+                                 std::make_shared<CacheFill>(response_cache_, conn->GetLoop(),
+                                                             key, token),
+                                 std::placeholders::_1),
+                       &pending->response);
+        return;
+    }
+  }
+
   http_callback_(req,
-                 std::bind(&HttpServer::RequestDone, this, conn, std::placeholders::_1),
-                 &response);
+                 std::bind(&HttpServer::RequestDone, this, conn, sequence, std::placeholders::_1),
+                 &pending->response);
 }
 
 void HttpServer::RequestDone(const TcpConnectionPtr& conn,
+                             uint64_t sequence,
                              const HttpResponse* response) {
-  Buffer buf;
-  response->AppendToBuffer(&buf);
-  conn->Send(&buf);
-  if (!response->keepalive()) {
+  EventLoop* loop = conn->GetLoop();
+  if (!loop->IsInLoopThread()) {
+    loop->RunInLoop(std::bind(&HttpServer::RequestDone, this, conn, sequence, response));
+    return;
+  }
+
+  Connection* connection = boost::any_cast<Connection>(conn->mutable_context());
+  assert(sequence - connection->first_sequence < connection->pending.size());
+  PendingResponse* pending = &connection->pending[sequence - connection->first_sequence];
+  assert(&pending->response == response);
+  pending->done = true;
+  Flush(conn, connection);
+}
+
+void HttpServer::CacheFillDone(const TcpConnectionPtr& conn,
+                              uint64_t sequence,
+                              const std::shared_ptr<CacheFill>& fill,
+                              const HttpResponse* response) {
+  fill->done = true;
+  EventLoop* loop = conn->GetLoop();
+  if (!loop->IsInLoopThread()) {
+    loop->RunInLoop(std::bind(&HttpServer::CacheFillDone, this, conn, sequence, fill, response));
+    return;
+  }
+
+  response_cache_->Fill(loop, fill->key, *response);
+  RequestDone(conn, sequence, response);
+}
+
+void HttpServer::CacheWaitDone(const TcpConnectionPtr& conn,
+                               uint64_t sequence,
+                               const std::shared_ptr<SavedRequest>& saved,
+                               const HttpResponseCache::EntryPtr& entry) {
+  Connection* connection = boost::any_cast<Connection>(conn->mutable_context());
+  assert(sequence - connection->first_sequence < connection->pending.size());
+  PendingResponse* pending = &connection->pending[sequence - connection->first_sequence];
+  if (entry) {
+    pending->cached = entry;
+    pending->done = true;
+    Flush(conn, connection);
+  } else {
+    // Not cacheable after all, made for this request too.
+    http_callback_(saved->request,
+                   std::bind(&HttpServer::RequestDone, this, conn, sequence, std::placeholders::_1),
+                   &pending->response);
+  }
+}
+
+void HttpServer::Flush(const TcpConnectionPtr& conn, Connection* connection) {
+  while (!connection->pending.empty() && connection->pending.front().done) {
+    const HttpResponse& response = connection->pending.front().response;
+    if (!connection->shutdown) {
+      StringPiece body = response.body();
+      if (connection->pending.front().cached) {
+        connection->pending.front().cached->AppendToBuffer(&connection->output,
+                                                            response.keepalive());
+      } else if (response.body_omitted()) {
+        response.AppendToBuffer(&connection->output);
+      } else if (response.file_fd() >= 0) {
+        response.AppendHeadToBuffer(&connection->output);
+        conn->Send(&connection->output);
+        conn->SendFile(response.file_fd(),
+                       response.file_offset(),
+                       response.file_length(),
+                       response.file_owner());
+      } else if (static_cast<size_t>(body.size()) >= kMinBodyToSendAlone) {
+        response.AppendHeadToBuffer(&connection->output);
+        conn->Send(&connection->output);
+        conn->Send(body);
+      } else {
+        response.AppendToBuffer(&connection->output);
+      }
+      if (!response.keepalive()) {
+        connection->shutdown = true;
+        connection->closing = true;
+      }
+    }
+    connection->pending.pop_front();
+    ++connection->first_sequence;
+  }
+
+  if (connection->batching) {
+    return;
+  }
+
+  if (connection->output.ReadableBytes() > 0) {
+    conn->Send(&connection->output);
+  }
+  if (connection->shutdown) {
     conn->Shutdown();
   }
+
+  // Requests left in the input buffer while paused.
+  if (connection->paused && connection->pending.size() < kMaxPendingResponses) {
+    HandleRequests(conn, connection, conn->input_buffer(), Timestamp::Now());
+  }
 }
 
 }  // namespace net
@@ -12,10 +12,16 @@
 #ifndef MUDUO_CPP11_NET_HTTP_HTTPSERVER_H
 #define MUDUO_CPP11_NET_HTTP_HTTPSERVER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <functional>
+#include <memory>
 #include <string>
 
 #include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/net/http/http_response_cache.h"
 #include "muduo-cpp11/net/tcp_server.h"
 
 namespace muduo_cpp11 {
@@ -27,12 +33,20 @@ class HttpResponse;
 /// A simple embeddable HTTP server designed for report status of a program.
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
 /// that can communicate with HttpClient and Web browser.
+///
+/// Pipelined requests are all handled as soon as they have arrived. The
+/// HttpCallback may answer later, from any thread, by calling the done
+/// callback; its HttpResponse stays valid until then. Responses go out in
+/// request order, those ready after one read in a single write.
 class HttpServer {
  public:
   typedef std::function<void (HttpResponse*)> RequestDoneCallback;
   typedef std::function<void (const HttpRequest&,
                               const RequestDoneCallback&,
                               HttpResponse*)> HttpCallback;
+  /// Receives a large request body piece by piece, ahead of the
+  /// HttpCallback of its request, which sees an empty body.
+  typedef std::function<void (const HttpRequest&, const StringPiece& data)> BodyCallback;
 
   HttpServer(EventLoop* loop,
              const InetAddress& listen_addr,
@@ -50,6 +64,26 @@ class HttpServer {
     http_callback_ = cb;
   }
 
+  /// Requests with a longer body are refused with 413. 1MB by default, 0
+  /// means unlimited.
+  void set_max_body_size(size_t max_body_size) {
+    max_body_size_ = max_body_size;
+  }
+
+  /// Bodies up to @max_buffered_body_size are kept in the input buffer and
+  /// passed with the request, longer ones are streamed to @cb.
+  void set_body_callback(const BodyCallback& cb,
+                         size_t max_buffered_body_size = 64 * 1024) {
+    body_callback_ = cb;
+    max_buffered_body_size_ = max_buffered_body_size;
+  }
+
+  /// Serves cacheable responses from @cache, NULL by default. Not thread
+  /// safe, call it before Start().
+  void set_response_cache(HttpResponseCache* cache) {
+    response_cache_ = cache;
+  }
+
   void set_thread_num(int num_threads) {
     server_.set_thread_num(num_threads);
   }
@@ -57,16 +91,43 @@ class HttpServer {
   void Start();
 
  private:
+  struct PendingResponse;
+  struct Connection;
+  struct SavedRequest;
+  struct CacheFill;
+
   void OnConnection(const TcpConnectionPtr& conn);
   void OnMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receive_time);
-  void OnRequest(const TcpConnectionPtr&, const HttpRequest&);
+  void HandleRequests(const TcpConnectionPtr& conn,
+                      Connection* connection,
+                      Buffer* buf,
+                      Timestamp receive_time);
+  // @raw is the bytes of @req in the input buffer.
+  void OnRequest(const TcpConnectionPtr& conn,
+                 Connection* connection,
+                 const HttpRequest& req,
+                 const StringPiece& raw);
   void RequestDone(const TcpConnectionPtr& conn,
+                   uint64_t sequence,
                    const HttpResponse* response);
+  void CacheFillDone(const TcpConnectionPtr& conn,
+                     uint64_t sequence,
+                     const std::shared_ptr<CacheFill>& fill,
+                     const HttpResponse* response);
+  void CacheWaitDone(const TcpConnectionPtr& conn,
+                     uint64_t sequence,
+                     const std::shared_ptr<SavedRequest>& saved,
+                     const HttpResponseCache::EntryPtr& entry);
+  void Flush(const TcpConnectionPtr& conn, Connection* connection);
 
   TcpServer server_;
   HttpCallback http_callback_;
+  BodyCallback body_callback_;
+  size_t max_body_size_;
+  size_t max_buffered_body_size_;
+  HttpResponseCache* response_cache_;
 
   DISABLE_COPY_AND_ASSIGN(HttpServer);
 };
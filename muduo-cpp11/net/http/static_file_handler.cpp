@@ -0,0 +1,629 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/http/static_file_handler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include "muduo-cpp11/base/logging.h"
+#include "muduo-cpp11/net/event_loop.h"
+#include "muduo-cpp11/net/http/http_request.h"
+#include "muduo-cpp11/net/http/http_response.h"
+
+using std::string;
+
+namespace muduo_cpp11 {
+namespace net {
+
+namespace {
+
+// Whatever makes the cached fd or stat results stale; a file replaced by
+// rename() loses a link, which is an IN_ATTRIB.
+const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+
+std::atomic<uint64_t> g_next_handler_id(1);
+
+struct ContentType {
+  const char* extension;
+  const char* type;
+};
+
+const ContentType kContentTypes[] = {
+  { "html", "text/html; charset=utf-8" },
+  { "htm", "text/html; charset=utf-8" },
+  { "css", "text/css" },
+  { "js", "application/javascript" },
+  { "json", "application/json" },
+  { "txt", "text/plain; charset=utf-8" },
+  { "xml", "application/xml" },
+  { "svg", "image/svg+xml" },
+  { "png", "image/png" },
+  { "jpg", "image/jpeg" },
+  { "jpeg", "image/jpeg" },
+  { "gif", "image/gif" },
+  { "ico", "image/x-icon" },
+  { "webp", "image/webp" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" },
+  { "wasm", "application/wasm" },
+  { "pdf", "application/pdf" },
+  { "mp4", "video/mp4" },
+};
+
+const char* GetContentType(const string& path) {
+  size_t dot = path.rfind('.');
+  if (dot != string::npos && path.find('/', dot) == string::npos) {
+    const char* extension = path.c_str() + dot + 1;
+    for (size_t i = 0; i < sizeof kContentTypes / sizeof kContentTypes[0]; ++i) {
+      if (strcasecmp(extension, kContentTypes[i].extension) == 0) {
+        return kContentTypes[i].type;
+      }
+    }
+  }
+  return "application/octet-stream";
+}
+
+string FormatHttpDate(const time_t seconds) {
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+  char buf[64];
+  size_t length = strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return string(buf, length);
+}
+
+bool ParseHttpDate(const StringPiece& date, time_t* seconds) {
+  string copy(date.as_string());
+  struct tm tm;
+  memset(&tm, 0, sizeof tm);
+  const char* end = strptime(copy.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (end == NULL || *end != '\0') {
+    return false;
+  }
+  *seconds = timegm(&tm);
+  return true;
+}
+
+int HexValue(const char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+    return (c | 0x20) - 'a' + 10;
+  }
+  return -1;
+}
+
+bool ParseNumber(const char* begin, const char* end, int64_t* value) {
+  if (begin == end || end - begin > 18) {
+    return false;
+  }
+  *value = 0;
+  for (const char* p = begin; p < end; ++p) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    *value = *value * 10 + (*p - '0');
+  }
+  return true;
+}
+
+StringPiece Trim(StringPiece s) {
+  while (!s.empty() && (s[0] == ' ' || s[0] == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s[s.size() - 1] == ' ' || s[s.size() - 1] == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// An open file and what is served with it. Shared with the sends still
+// using its fd, which is closed after the last of them.
+struct File {
+  File()
+      : fd(-1),
+        size(0),
+        mtime(0),
+        hits(0),
+        wd(-1) {
+  }
+
+  ~File() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  string path;
+  int fd;
+  int64_t size;
+  time_t mtime;
+  string etag;
+  string last_modified;
+  // Content-Type, ETag, Last-Modified and Accept-Ranges lines.
+  std::shared_ptr<const string> header_block;
+  // The whole file, once it turns out to be hot and small enough.
+  std::shared_ptr<const string> content;
+  int hits;
+  int wd;
+};
+
+typedef std::shared_ptr<File> FilePtr;
+
+// Opens @path, NULL with errno set on failure.
+FilePtr OpenFile(const string& path) {
+  FilePtr file(new File);
+  file->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file->fd < 0) {
+    return FilePtr();
+  }
+
+  struct stat st;
+  if (::fstat(file->fd, &st) < 0) {
+    return FilePtr();
+  }
+  if (!S_ISREG(st.st_mode)) {
+    errno = ENOENT;
+    return FilePtr();
+  }
+
+  file->path = path;
+  file->size = st.st_size;
+  file->mtime = st.st_mtim.tv_sec;
+
+  char buf[64];
+  snprintf(buf, sizeof buf, "\"%llx-%llx%09lx\"",
+           static_cast<unsigned long long>(st.st_size),
+           static_cast<unsigned long long>(st.st_mtim.tv_sec),
+           static_cast<long>(st.st_mtim.tv_nsec));
+  file->etag = buf;
+  file->last_modified = FormatHttpDate(file->mtime);
+
+  string* block = new string;
+  block->append("Content-Type: ").append(GetContentType(path)).append("\r\n");
+  block->append("ETag: ").append(file->etag).append("\r\n");
+  block->append("Last-Modified: ").append(file->last_modified).append("\r\n");
+  block->append("Accept-Ranges: bytes\r\n");
+  file->header_block.reset(block);
+  return file;
+}
+
+std::shared_ptr<const string> ReadContent(const File& file) {
+  string* content = new string(static_cast<size_t>(file.size), '\0');
+  std::shared_ptr<const string> holder(content);
+  size_t done = 0;
+  while (done < content->size()) {
+    ssize_t n = ::pread(file.fd, &(*content)[done], content->size() - done, done);
+    if (n <= 0) {
+      return std::shared_ptr<const string>();
+    }
+    done += n;
+  }
+  return holder;
+}
+
+// Whether the client's copy, validated by If-None-Match or else by
+// If-Modified-Since, is still current.
+bool IsNotModified(const HttpRequest& req, const File& file) {
+  StringPiece if_none_match = req.GetHeader("If-None-Match");
+  if (!if_none_match.empty()) {
+    while (!if_none_match.empty()) {
+      const char* comma = static_cast<const char*>(
+          memchr(if_none_match.data(), ',', if_none_match.size()));
+      int length = comma != NULL ? static_cast<int>(comma - if_none_match.data())
+                                 : if_none_match.size();
+      StringPiece tag = Trim(StringPiece(if_none_match.data(), length));
+      if (tag.starts_with("W/")) {
+        tag.remove_prefix(2);
+      }
+      if (tag == "*" || tag == file.etag) {
+        return true;
+      }
+      if_none_match.remove_prefix(comma != NULL ? length + 1 : length);
+    }
+    return false;
+  }
+
+  StringPiece if_modified_since = req.GetHeader("If-Modified-Since");
+  if (if_modified_since.empty()) {
+    return false;
+  }
+  // Clients mostly send back the Last-Modified they got.
+  if (if_modified_since == file.last_modified) {
+    return true;
+  }
+  time_t since = 0;
+  return ParseHttpDate(if_modified_since, &since) && file.mtime <= since;
+}
+
+enum RangeResult {
+  kWholeFile,
+  kPartial,
+  kUnsatisfiable,
+};
+
+// Only a single range is served, a header which is malformed or asks for
+// several ranges gets the whole file, as RFC 7233 allows.
+RangeResult ParseRange(const HttpRequest& req,
+                       const File& file,
+                       int64_t* first,
+                       int64_t* last) {
+  StringPiece range = req.GetHeader("Range");
+  if (range.empty() || !range.starts_with("bytes=")) {
+    return kWholeFile;
+  }
+
+  StringPiece if_range = req.GetHeader("If-Range");
+  if (!if_range.empty() && if_range != file.etag && if_range != file.last_modified) {
+    return kWholeFile;
+  }
+
+  range.remove_prefix(6);
+  const char* begin = range.data();
+  const char* end = begin + range.size();
+  const char* dash = static_cast<const char*>(memchr(begin, '-', end - begin));
+  if (dash == NULL || memchr(begin, ',', end - begin) != NULL) {
+    return kWholeFile;
+  }
+
+  if (dash == begin) {
+    int64_t suffix = 0;
+    if (!ParseNumber(dash + 1, end, &suffix)) {
+      return kWholeFile;
+    }
+    if (suffix == 0 || file.size == 0) {
+      return kUnsatisfiable;
+    }
+    *first = suffix < file.size ? file.size - suffix : 0;
+    *last = file.size - 1;
+    return kPartial;
+  }
+
+  if (!ParseNumber(begin, dash, first)) {
+    return kWholeFile;
+  }
+  *last = file.size - 1;
+  if (dash + 1 != end) {
+    if (!ParseNumber(dash + 1, end, last) || *last < *first) {
+      return kWholeFile;
+    }
+  }
+  if (*first >= file.size) {
+    return kUnsatisfiable;
+  }
+  if (*last >= file.size) {
+    *last = file.size - 1;
+  }
+  return kPartial;
+}
+
+}  // namespace
+
+// The files opened in one loop, most recently used first.
+class StaticFileHandler::Cache {
+ public:
+  Cache(EventLoop* loop, const size_t max_files)
+      : loop_(loop),
+        max_files_(max_files),
+        inotify_fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+        drained_iteration_(-1) {
+    // Without it changes would go unnoticed, nothing is kept then.
+    if (inotify_fd_ < 0) {
+      LOG(ERROR) << "inotify_init1: " << strerror_tl(errno);
+    }
+  }
+
+  ~Cache() {
+    if (inotify_fd_ >= 0) {
+      ::close(inotify_fd_);
+    }
+  }
+
+  EventLoop* loop() const {
+    return loop_;
+  }
+
+  // NULL with errno set if it cannot be opened.
+  FilePtr Get(const string& path) {
+    DrainEvents();
+
+    std::unordered_map<string, FileList::iterator>::iterator found = files_.find(path);
+    if (found != files_.end()) {
+      lru_.splice(lru_.begin(), lru_, found->second);
+      return *found->second;
+    }
+
+    if (inotify_fd_ < 0 || max_files_ == 0) {
+      return OpenFile(path);
+    }
+
+    // Watched before it is opened, so no change slips in between.
+    int wd = ::inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+    if (wd < 0) {
+      return OpenFile(path);
+    }
+
+    FilePtr file(OpenFile(path));
+    if (!file) {
+      int saved_errno = errno;
+      RemoveWatch(wd);
+      errno = saved_errno;
+      return file;
+    }
+
+    file->wd = wd;
+    lru_.push_front(file);
+    files_[path] = lru_.begin();
+    watches_.insert(std::make_pair(wd, path));
+    if (lru_.size() > max_files_) {
+      Remove(lru_.back()->path, true);
+    }
+    return file;
+  }
+
+ private:
+  typedef std::list<FilePtr> FileList;
+
+  void DrainEvents() {
+    if (inotify_fd_ < 0 || loop_->iteration() == drained_iteration_) {
+      return;
+    }
+    drained_iteration_ = loop_->iteration();
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+      ssize_t n = ::read(inotify_fd_, buf, sizeof buf);
+      if (n <= 0) {
+        break;
+      }
+
+      for (const char* p = buf; p < buf + n; ) {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+        if (event->mask & IN_Q_OVERFLOW) {
+          Clear();
+        } else {
+          Invalidate(event->wd, (event->mask & IN_IGNORED) != 0);
+        }
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+
+  // @removed: the kernel has dropped the watch already.
+  void Invalidate(const int wd, const bool removed) {
+    std::pair<WatchMap::iterator, WatchMap::iterator> range = watches_.equal_range(wd);
+    std::vector<string> paths;
+    for (WatchMap::iterator it = range.first; it != range.second; ++it) {
+      paths.push_back(it->second);
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+      Remove(paths[i], !removed);
+    }
+  }
+
+  void Remove(const string& path, const bool remove_watch) {
+    std::unordered_map<string, FileList::iterator>::iterator found = files_.find(path);
+    if (found == files_.end()) {
+      return;
+    }
+
+    int wd = (*found->second)->wd;
+    lru_.erase(found->second);
+    files_.erase(found);
+
+    std::pair<WatchMap::iterator, WatchMap::iterator> range = watches_.equal_range(wd);
+    for (WatchMap::iterator it = range.first; it != range.second; ++it) {
+      if (it->second == path) {
+        watches_.erase(it);
+        break;
+      }
+    }
+    if (remove_watch) {
+      RemoveWatch(wd);
+    }
+  }
+
+  // Unless another path of the same file still uses it.
+  void RemoveWatch(const int wd) {
+    if (watches_.count(wd) == 0) {
+      ::inotify_rm_watch(inotify_fd_, wd);
+    }
+  }
+
+  void Clear() {
+    for (WatchMap::iterator it = watches_.begin(); it != watches_.end(); ++it) {
+      ::inotify_rm_watch(inotify_fd_, it->first);
+    }
+    watches_.clear();
+    files_.clear();
+    lru_.clear();
+  }
+
+  typedef std::unordered_multimap<int, string> WatchMap;
+
+  EventLoop* const loop_;
+  const size_t max_files_;
+  const int inotify_fd_;
+  int64_t drained_iteration_;
+  FileList lru_;
+  std::unordered_map<string, FileList::iterator> files_;
+  WatchMap watches_;
+
+  DISABLE_COPY_AND_ASSIGN(Cache);
+};
+
+StaticFileHandler::StaticFileHandler(const string& root)
+    : root_(root),
+      id_(g_next_handler_id++),
+      max_cached_files_(1024),
+      max_memory_file_size_(16 * 1024) {
+}
+
+StaticFileHandler::~StaticFileHandler() {
+}
+
+void StaticFileHandler::HandleRequest(const HttpRequest& req,
+                                      const HttpServer::RequestDoneCallback& done,
+                                      HttpResponse* resp) {
+  if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead) {
+    resp->set_status_code(HttpResponse::k405MethodNotAllowed);
+    resp->AddHeader("Allow", "GET, HEAD");
+    done(resp);
+    return;
+  }
+
+  string path;
+  FilePtr file;
+  if (MapPath(req.path(), &path)) {
+    file = GetCache(EventLoop::GetEventLoopOfCurrentThread())->Get(path);
+  } else {
+    errno = ENOENT;
+  }
+  if (!file) {
+    resp->set_status_code(errno == EACCES ? HttpResponse::k403Forbidden
+                                          : HttpResponse::k404NotFound);
+    done(resp);
+    return;
+  }
+
+  resp->set_header_block(file->header_block);
+  if (IsNotModified(req, *file)) {
+    resp->set_status_code(HttpResponse::k304NotModified);
+    done(resp);
+    return;
+  }
+
+  if (req.method() == HttpRequest::kHead) {
+    resp->set_body_omitted(true);
+  }
+
+  int64_t first = 0;
+  int64_t last = 0;
+  RangeResult range = ParseRange(req, *file, &first, &last);
+  char content_range[64];
+  if (range == kUnsatisfiable) {
+    snprintf(content_range, sizeof content_range, "bytes */%lld",
+             static_cast<long long>(file->size));
+    resp->set_status_code(HttpResponse::k416RangeNotSatisfiable);
+    resp->AddHeader("Content-Range", content_range);
+    resp->set_body_omitted(false);
+    done(resp);
+    return;
+  }
+
+  if (range == kPartial) {
+    snprintf(content_range, sizeof content_range, "bytes %lld-%lld/%lld",
+             static_cast<long long>(first),
+             static_cast<long long>(last),
+             static_cast<long long>(file->size));
+    resp->set_status_code(HttpResponse::k206PartialContent);
+    resp->AddHeader("Content-Range", content_range);
+    resp->set_file_body(file->fd, first, static_cast<size_t>(last - first + 1), file);
+    done(resp);
+    return;
+  }
+
+  // Kept in memory from the second request on, once is not hot.
+  if (!file->content && ++file->hits >= 2 &&
+      file->size <= static_cast<int64_t>(max_memory_file_size_)) {
+    file->content = ReadContent(*file);
+  }
+
+  resp->set_status_code(HttpResponse::k200Ok);
+  if (file->content) {
+    resp->set_shared_body(file->content);
+  } else {
+    resp->set_file_body(file->fd, 0, static_cast<size_t>(file->size), file);
+  }
+  done(resp);
+}
+
+StaticFileHandler::Cache* StaticFileHandler::GetCache(EventLoop* loop) {
+  // Not the StaticFileHandler pointer, a new one may reuse the address of
+  // a destroyed one.
+  struct LastCache {
+    uint64_t owner_id;
+    Cache* cache;
+  };
+  static thread_local LastCache t_last = { 0, NULL };
+
+  if (t_last.owner_id == id_ && t_last.cache->loop() == loop) {
+    return t_last.cache;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Cache* cache = NULL;
+  for (size_t i = 0; i < caches_.size(); ++i) {
+    if (caches_[i]->loop() == loop) {
+      cache = caches_[i].get();
+      break;
+    }
+  }
+
+  if (cache == NULL) {
+    caches_.emplace_back(new Cache(loop, max_cached_files_));
+    cache = caches_.back().get();
+  }
+
+  t_last.owner_id = id_;
+  t_last.cache = cache;
+  return cache;
+}
+
+bool StaticFileHandler::MapPath(const StringPiece& url_path, string* path) const {
+  if (url_path.empty() || url_path[0] != '/') {
+    return false;
+  }
+
+  path->assign(root_);
+  size_t segment = path->size();
+  for (int i = 0; i < url_path.size(); ++i) {
+    char c = url_path[i];
+    if (c == '%') {
+      int high = i + 2 < url_path.size() ? HexValue(url_path[i + 1]) : -1;
+      int low = high >= 0 ? HexValue(url_path[i + 2]) : -1;
+      if (low < 0) {
+        return false;
+      }
+      c = static_cast<char>(high * 16 + low);
+      i += 2;
+    }
+    if (c == '\0') {
+      return false;
+    }
+
+    // Checked once decoded, so "%2e%2e" is caught too.
+    if (c == '/') {
+      if (path->compare(segment, string::npos, "/..") == 0) {
+        return false;
+      }
+      segment = path->size();
+    }
+    path->push_back(c);
+  }
+  if (path->compare(segment, string::npos, "/..") == 0) {
+    return false;
+  }
+
+  if ((*path)[path->size() - 1] == '/') {
+    path->append("index.html");
+  }
+  return true;
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
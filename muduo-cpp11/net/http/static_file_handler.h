@@ -0,0 +1,94 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_CPP11_NET_HTTP_STATICFILEHANDLER_H_
+#define MUDUO_CPP11_NET_HTTP_STATICFILEHANDLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/net/http/http_server.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+class EventLoop;
+class HttpRequest;
+class HttpResponse;
+
+///
+/// Serves the files under a directory, as the HttpCallback of an
+/// HttpServer:
+///
+///   StaticFileHandler files("/var/www");
+///   server.set_http_callback(std::bind(&StaticFileHandler::HandleRequest,
+///                                      &files, _1, _2, _3));
+///
+/// Each loop keeps an LRU cache of open files with their stat results and
+/// validators, so a hit costs no system call but the sendfile(2) of the
+/// body. An inotify watch on every cached file drops it once it is
+/// modified, replaced or removed; the events are read at most once per
+/// loop iteration. Small files are kept in memory too, with their headers
+/// preformatted, from their second request on.
+///
+/// Answers GET and HEAD, If-None-Match and If-Modified-Since against the
+/// ETag and Last-Modified of the file, and a single range of Range, also
+/// checking If-Range. Paths with a ".." segment are refused, a path
+/// ending with '/' serves its index.html.
+///
+/// Must outlive the servers using it.
+class StaticFileHandler {
+ public:
+  explicit StaticFileHandler(const std::string& root);
+  ~StaticFileHandler();
+
+  /// Files cached by each loop, 1024 by default. Must be called before
+  /// the first request, as the next one.
+  void set_max_cached_files(const size_t max_files) {
+    max_cached_files_ = max_files;
+  }
+
+  /// Files up to this size are also kept in memory, 16KB by default. 0
+  /// disables it.
+  void set_max_memory_file_size(const size_t max_size) {
+    max_memory_file_size_ = max_size;
+  }
+
+  /// Must be called in a loop thread.
+  void HandleRequest(const HttpRequest& req,
+                     const HttpServer::RequestDoneCallback& done,
+                     HttpResponse* resp);
+
+ private:
+  class Cache;
+
+  Cache* GetCache(EventLoop* loop);
+  bool MapPath(const StringPiece& url_path, std::string* path) const;
+
+ private:
+  const std::string root_;
+  const uint64_t id_;
+  size_t max_cached_files_;
+  size_t max_memory_file_size_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Cache>> caches_;  // @GuardedBy mutex_
+
+  DISABLE_COPY_AND_ASSIGN(StaticFileHandler);
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_HTTP_STATICFILEHANDLER_H_
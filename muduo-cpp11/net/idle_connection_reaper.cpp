@@ -0,0 +1,95 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/idle_connection_reaper.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include "muduo-cpp11/base/logging.h"
+#include "muduo-cpp11/base/weak_callback.h"
+#include "muduo-cpp11/net/event_loop.h"
+#include "muduo-cpp11/net/tcp_connection.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+namespace {
+
+// Sweep at least once a second, and at least 8 times per idle period.
+const double kMaxTickSeconds = 1.0;
+const int kMinTicksPerPeriod = 8;
+
+}  // namespace
+
+IdleConnectionReaper::IdleConnectionReaper(EventLoop* loop, double idle_seconds)
+    : loop_(CHECK_NOTNULL(loop)),
+      idle_seconds_(idle_seconds),
+      tick_seconds_(kMaxTickSeconds),
+      cursor_(0) {
+  assert(idle_seconds_ > 0.0);
+  if (idle_seconds_ / kMinTicksPerPeriod < tick_seconds_) {
+    tick_seconds_ = idle_seconds_ / kMinTicksPerPeriod;
+  }
+  // one more bucket, so a new deadline never lands on the current one.
+  buckets_.resize(static_cast<size_t>(ceil(idle_seconds_ / tick_seconds_)) + 1);
+}
+
+IdleConnectionReaper::~IdleConnectionReaper() {
+  loop_->Cancel(timer_id_);
+}
+
+void IdleConnectionReaper::Start() {
+  timer_id_ = loop_->RunEvery(tick_seconds_,
+                              MakeWeakCallback(shared_from_this(),
+                                               &IdleConnectionReaper::OnTick));
+}
+
+void IdleConnectionReaper::Add(const TcpConnectionPtr& conn) {
+  loop_->AssertInLoopThread();
+  assert(conn->GetLoop() == loop_);
+  Insert(conn, idle_seconds_);
+}
+
+void IdleConnectionReaper::Insert(const TcpConnectionPtr& conn,
+                                  double remaining_seconds) {
+  size_t ticks = static_cast<size_t>(ceil(remaining_seconds / tick_seconds_));
+  if (ticks < 1) {
+    ticks = 1;
+  } else if (ticks >= buckets_.size()) {
+    ticks = buckets_.size() - 1;
+  }
+  buckets_[(cursor_ + ticks) % buckets_.size()].push_back(conn);
+}
+
+void IdleConnectionReaper::OnTick() {
+  loop_->AssertInLoopThread();
+  cursor_ = (cursor_ + 1) % buckets_.size();
+  sweeping_.swap(buckets_[cursor_]);
+
+  Timestamp now(loop_->cached_now());
+  for (Bucket::iterator it = sweeping_.begin(); it != sweeping_.end(); ++it) {
+    TcpConnectionPtr conn(it->lock());
+    if (!conn || !conn->connected()) {
+      continue;
+    }
+
+    double idle = TimeDifference(now, conn->last_active_time());
+    if (idle >= idle_seconds_) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+      LogDebug("IdleConnectionReaper closes [%s], idle for %.3f seconds", conn->name().c_str(), idle);
+#else
+      VLOG(1) << "IdleConnectionReaper closes [" << conn->name() << "], idle for " << idle << " seconds";
+#endif
+      conn->ForceClose();
+    } else {
+      Insert(conn, idle_seconds_ - idle);
+    }
+  }
+  sweeping_.clear();
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
@@ -0,0 +1,65 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_CPP11_NET_IDLE_CONNECTION_REAPER_H_
+#define MUDUO_CPP11_NET_IDLE_CONNECTION_REAPER_H_
+
+#include <memory>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/net/callbacks.h"
+#include "muduo-cpp11/net/timer_id.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+class EventLoop;
+
+///
+/// Closes the connections of one EventLoop which stay idle too long.
+///
+/// It's a lazy timing wheel: connections only record the time of their
+/// last read/write, and one repeating timer sweeps a bucket per tick.
+/// A connection found active is moved to the bucket of its new deadline,
+/// so each connection is visited about once per idle period, no matter
+/// how much traffic it has.
+///
+/// All methods except the ctor must be called in the loop thread.
+class IdleConnectionReaper
+    : public std::enable_shared_from_this<IdleConnectionReaper> {
+ public:
+  IdleConnectionReaper(EventLoop* loop, double idle_seconds);
+  ~IdleConnectionReaper();
+
+  /// Starts the sweeping timer, thread safe.
+  void Start();
+
+  void Add(const TcpConnectionPtr& conn);
+
+ private:
+  typedef std::vector<std::weak_ptr<TcpConnection>> Bucket;
+
+  void OnTick();
+  void Insert(const TcpConnectionPtr& conn, double remaining_seconds);
+
+  EventLoop* loop_;
+  const double idle_seconds_;
+  double tick_seconds_;
+
+  std::vector<Bucket> buckets_;
+  size_t cursor_;  // the bucket swept by the last tick
+  Bucket sweeping_;  // scratch, keeps its capacity between ticks
+  TimerId timer_id_;
+
+  DISABLE_COPY_AND_ASSIGN(IdleConnectionReaper);
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_IDLE_CONNECTION_REAPER_H_
@@ -0,0 +1,281 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/offload_pipeline.h"
+
+#include <assert.h>
+
+#include <atomic>
+#include <functional>
+#include <utility>
+
+#include "muduo-cpp11/base/thread_pool.h"
+#include "muduo-cpp11/net/event_loop.h"
+#include "muduo-cpp11/net/tcp_connection.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+namespace {
+
+// How soon a connection blocked while its loop has nothing in flight, so
+// no completion will trigger the resume callback, is retried.
+const double kRetryDelaySeconds = 0.01;
+
+std::atomic<uint64_t> g_next_pipeline_id(1);
+
+}  // namespace
+
+// Delivers an empty completion if the pool drops it unrun, e.g. under
+// kDiscardOldest, so the later completions of its connection are not held
+// back.
+class OffloadPipeline::Task {
+ public:
+  Task(OffloadPipeline* pipeline,
+       LoopState* state,
+       const TcpConnectionPtr& conn,
+       const uint64_t sequence,
+       Work work)
+      : pipeline_(pipeline),
+        state_(state),
+        conn_(conn),
+        sequence_(sequence),
+        work_(std::move(work)) {
+  }
+
+  ~Task() {
+    if (conn_) {
+      Result result;
+      result.conn.swap(conn_);
+      result.sequence = sequence_;
+      pipeline_->Finish(state_, std::move(result));
+    }
+  }
+
+  void operator()() {
+    Result result;
+    result.conn.swap(conn_);
+    result.sequence = sequence_;
+    result.completion = work_();
+    pipeline_->Finish(state_, std::move(result));
+  }
+
+  // Rejected by the pool, nothing to deliver.
+  void Cancel() {
+    conn_.reset();
+  }
+
+ private:
+  OffloadPipeline* pipeline_;
+  LoopState* state_;
+  TcpConnectionPtr conn_;
+  uint64_t sequence_;
+  Work work_;
+
+  DISABLE_COPY_AND_ASSIGN(Task);
+};
+
+// What the pool runs. The Task stays where Submit() can cancel it when
+// rejected; too big to be stored inline, it would be allocated anyway.
+class OffloadPipeline::TaskRunner {
+ public:
+  explicit TaskRunner(std::unique_ptr<Task> task)
+      : task_(std::move(task)) {
+  }
+
+  void operator()() {
+    (*task_)();
+  }
+
+ private:
+  std::unique_ptr<Task> task_;
+};
+
+OffloadPipeline::OffloadPipeline(ThreadPool* pool)
+    : pool_(pool),
+      id_(g_next_pipeline_id++),
+      max_in_flight_per_connection_(16),
+      max_in_flight_per_loop_(1024) {
+}
+
+OffloadPipeline::~OffloadPipeline() {
+}
+
+bool OffloadPipeline::Submit(const TcpConnectionPtr& conn, Work work) {
+  EventLoop* loop = conn->GetLoop();
+  loop->AssertInLoopThread();
+  LoopState* state = GetLoopState(loop);
+
+  std::unordered_map<TcpConnection*, ConnectionState>::iterator it = state->connections.find(conn.get());
+  size_t conn_in_flight = it != state->connections.end() ? it->second.in_flight : 0;
+  if ((max_in_flight_per_loop_ > 0 && state->in_flight >= max_in_flight_per_loop_) ||
+      (max_in_flight_per_connection_ > 0 && conn_in_flight >= max_in_flight_per_connection_)) {
+    Block(state, conn);
+    return false;
+  }
+
+  ConnectionState& conn_state = state->connections[conn.get()];
+  std::unique_ptr<Task> owned(new Task(this, state, conn, conn_state.next_sequence, std::move(work)));
+  Task* submitted = owned.get();
+  ThreadPool::Task task(TaskRunner(std::move(owned)));
+  if (!pool_->TryRun(std::move(task))) {
+    submitted->Cancel();
+    if (conn_state.in_flight == 0) {
+      state->connections.erase(conn.get());
+    }
+    Block(state, conn);
+    return false;
+  }
+
+  // The completion is delivered by a queued Drain(), so even if the pool
+  // ran the task right here, it is counted before it is delivered.
+  ++conn_state.next_sequence;
+  ++conn_state.in_flight;
+  ++state->in_flight;
+  return true;
+}
+
+OffloadPipeline::LoopState* OffloadPipeline::GetLoopState(EventLoop* loop) {
+  // Not the OffloadPipeline pointer, a new one may reuse the address of a
+  // destroyed one.
+  struct Cache {
+    uint64_t owner_id;
+    LoopState* state;
+  };
+  static thread_local Cache t_cache = { 0, NULL };
+
+  if (t_cache.owner_id == id_ && t_cache.state->loop == loop) {
+    return t_cache.state;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  LoopState* state = NULL;
+  for (size_t i = 0; i < loops_.size(); ++i) {
+    if (loops_[i]->loop == loop) {
+      state = loops_[i].get();
+      break;
+    }
+  }
+
+  if (state == NULL) {
+    loops_.emplace_back(new LoopState(loop));
+    state = loops_.back().get();
+  }
+
+  t_cache.owner_id = id_;
+  t_cache.state = state;
+  return state;
+}
+
+void OffloadPipeline::Finish(LoopState* state, Result result) {
+  bool queue_drain = false;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->finished.push_back(std::move(result));
+    if (!state->drain_queued) {
+      state->drain_queued = true;
+      queue_drain = true;
+    }
+  }
+
+  // Later completions ride along with the queued drain.
+  if (queue_drain) {
+    state->loop->QueueInLoop(std::bind(&OffloadPipeline::Drain, this, state));
+  }
+}
+
+void OffloadPipeline::Block(LoopState* state, const TcpConnectionPtr& conn) {
+  if (!resume_callback_) {
+    return;
+  }
+
+  state->blocked.insert(conn);
+  if (state->in_flight == 0 && !state->retry_queued) {
+    state->retry_queued = true;
+    state->loop->RunAfter(kRetryDelaySeconds, std::bind(&OffloadPipeline::Retry, this, state));
+  }
+}
+
+void OffloadPipeline::Drain(LoopState* state) {
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->draining.swap(state->finished);
+    state->drain_queued = false;
+  }
+
+  for (size_t i = 0; i < state->draining.size(); ++i) {
+    Deliver(state, &state->draining[i]);
+  }
+  state->draining.clear();
+
+  ResumeBlocked(state);
+}
+
+void OffloadPipeline::Deliver(LoopState* state, Result* result) {
+  TcpConnection* key = result->conn.get();
+  assert(state->connections.find(key) != state->connections.end());
+  // A reference stays valid even if a completion submits and rehashes
+  // the map.
+  ConnectionState& conn_state = state->connections[key];
+
+  if (result->sequence != conn_state.next_delivery) {
+    conn_state.out_of_order.insert(std::make_pair(result->sequence, std::move(result->completion)));
+    return;
+  }
+
+  Completion completion(std::move(result->completion));
+  for (;;) {
+    ++conn_state.next_delivery;
+    --conn_state.in_flight;
+    --state->in_flight;
+    if (completion) {
+      completion(result->conn);
+    }
+
+    std::map<uint64_t, Completion>::iterator it = conn_state.out_of_order.begin();
+    if (it == conn_state.out_of_order.end() || it->first != conn_state.next_delivery) {
+      break;
+    }
+    completion = std::move(it->second);
+    conn_state.out_of_order.erase(it);
+  }
+
+  if (conn_state.in_flight == 0) {
+    state->connections.erase(key);
+  }
+}
+
+void OffloadPipeline::Retry(LoopState* state) {
+  state->retry_queued = false;
+  ResumeBlocked(state);
+}
+
+void OffloadPipeline::ResumeBlocked(LoopState* state) {
+  if (state->blocked.empty() ||
+      (max_in_flight_per_loop_ > 0 && state->in_flight >= max_in_flight_per_loop_)) {
+    return;
+  }
+
+  BlockedSet blocked;
+  blocked.swap(state->blocked);
+  for (BlockedSet::iterator it = blocked.begin(); it != blocked.end(); ++it) {
+    TcpConnectionPtr conn(it->lock());
+    if (!conn) {
+      continue;
+    }
+
+    std::unordered_map<TcpConnection*, ConnectionState>::iterator found = state->connections.find(conn.get());
+    if (max_in_flight_per_connection_ > 0 && found != state->connections.end() &&
+        found->second.in_flight >= max_in_flight_per_connection_) {
+      state->blocked.insert(*it);
+      continue;
+    }
+
+    resume_callback_(conn);
+  }
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
@@ -0,0 +1,166 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_CPP11_NET_OFFLOAD_PIPELINE_H_
+#define MUDUO_CPP11_NET_OFFLOAD_PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/base/move_only_function.h"
+#include "muduo-cpp11/net/callbacks.h"
+
+namespace muduo_cpp11 {
+
+class ThreadPool;
+
+namespace net {
+
+class EventLoop;
+
+///
+/// Runs CPU heavy work of connections in a ThreadPool, and the follow-up,
+/// typically sending the response, back in the connection's own loop:
+///
+///   bool ok = pipeline.Submit(conn, std::bind([](const RequestPtr& request) {
+///     std::shared_ptr<std::string> body(new std::string(Encode(*request)));
+///     return OffloadPipeline::Completion([body](const TcpConnectionPtr& conn) {
+///       conn->Send(*body);
+///     });
+///   }, request));
+///
+/// Completions of one connection run in submission order. Each loop
+/// collects the completions finished by workers in one list and drains it
+/// from a single queued functor, so a busy loop handles many of them per
+/// wakeup.
+///
+/// Submit() never blocks: it fails when the connection or its loop has
+/// too much work in flight, or the pool's queue is full. The resume
+/// callback tells when a connection that failed may submit again, e.g. to
+/// StartRead() after a StopRead().
+///
+/// The pool must not use ThreadPool::kCallerRuns, which would run the work
+/// in the loop. Work it drops, under kDiscardOldest or when it stops,
+/// gets no completion; the following ones are delivered all the same.
+///
+/// The pipeline must outlive the work submitted to it, i.e. stop the pool
+/// and quit the loops first.
+class OffloadPipeline {
+ public:
+  /// Runs in the connection's loop, even if it has disconnected meanwhile.
+  typedef MoveOnlyFunction<void (const TcpConnectionPtr&)> Completion;
+  /// Runs in a worker thread.
+  typedef MoveOnlyFunction<Completion ()> Work;
+
+  explicit OffloadPipeline(ThreadPool* pool);
+  ~OffloadPipeline();
+
+  // Must be called before the first Submit(). 0 means unlimited.
+  void set_max_in_flight_per_connection(const size_t max_in_flight) {
+    max_in_flight_per_connection_ = max_in_flight;
+  }
+
+  void set_max_in_flight_per_loop(const size_t max_in_flight) {
+    max_in_flight_per_loop_ = max_in_flight;
+  }
+
+  void set_resume_callback(const ConnectionCallback& cb) {
+    resume_callback_ = cb;
+  }
+
+  /// Must be called in the loop thread of @conn.
+  bool Submit(const TcpConnectionPtr& conn, Work work);
+
+ private:
+  struct Result {
+    TcpConnectionPtr conn;
+    uint64_t sequence;
+    Completion completion;
+  };
+
+  struct ConnectionState {
+    ConnectionState()
+        : next_sequence(0),
+          next_delivery(0),
+          in_flight(0) {
+    }
+
+    uint64_t next_sequence;
+    uint64_t next_delivery;
+    size_t in_flight;
+    // Finished ahead of an earlier submission.
+    std::map<uint64_t, Completion> out_of_order;
+  };
+
+  typedef std::set<std::weak_ptr<TcpConnection>,
+                   std::owner_less<std::weak_ptr<TcpConnection>>> BlockedSet;
+
+  // Owned by one loop; only finished and drain_queued are touched by
+  // workers.
+  struct LoopState {
+    explicit LoopState(EventLoop* event_loop)
+        : loop(event_loop),
+          in_flight(0),
+          retry_queued(false),
+          drain_queued(false) {
+    }
+
+    EventLoop* const loop;
+    size_t in_flight;
+    // Connections with work in flight, which keeps them alive, so the
+    // pointer is not reused while in the map.
+    std::unordered_map<TcpConnection*, ConnectionState> connections;
+    // Connections which failed to submit, due for the resume callback.
+    BlockedSet blocked;
+    bool retry_queued;
+
+    std::mutex mutex;
+    std::vector<Result> finished;  // @GuardedBy mutex
+    bool drain_queued;  // @GuardedBy mutex
+
+    // Scratch for Drain(), keeps its capacity.
+    std::vector<Result> draining;
+  };
+
+  class Task;
+  class TaskRunner;
+
+  LoopState* GetLoopState(EventLoop* loop);
+  void Finish(LoopState* state, Result result);
+
+  // Run in the loop thread.
+  void Block(LoopState* state, const TcpConnectionPtr& conn);
+  void Drain(LoopState* state);
+  void Deliver(LoopState* state, Result* result);
+  void Retry(LoopState* state);
+  void ResumeBlocked(LoopState* state);
+
+ private:
+  ThreadPool* pool_;
+  const uint64_t id_;
+  size_t max_in_flight_per_connection_;
+  size_t max_in_flight_per_loop_;
+  ConnectionCallback resume_callback_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<LoopState>> loops_;  // @GuardedBy mutex_
+
+  DISABLE_COPY_AND_ASSIGN(OffloadPipeline);
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_OFFLOAD_PIPELINE_H_
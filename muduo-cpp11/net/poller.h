@@ -35,7 +35,8 @@ class Poller {
   explicit Poller(EventLoop* loop);
   virtual ~Poller();
 
-  /// Polls the I/O events.
+  /// Polls the I/O events, returns Timestamp::MonotonicNow() of when
+  /// poll returns.
   /// Must be called in the loop thread.
   virtual Timestamp Poll(int timeout_ms, ChannelList* active_channels) = 0;
 
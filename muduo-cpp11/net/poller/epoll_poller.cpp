@@ -14,6 +14,7 @@
 #include <poll.h>
 #include <sys/epoll.h>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/net/channel.h"
 
@@ -54,7 +55,7 @@ Timestamp EPollPoller::Poll(int timeout_ms, ChannelList* active_channels) {
                                 static_cast<int>(events_.size()),
                                 timeout_ms);
   int saved_errno = errno;
-  Timestamp now(Timestamp::Now());
+  Timestamp now(Timestamp::MonotonicNow());
   if (num_events > 0) {
     if (VLOG_IS_ON(1)) {
       LOG(INFO) << num_events << " events happended";
@@ -71,7 +72,7 @@ Timestamp EPollPoller::Poll(int timeout_ms, ChannelList* active_channels) {
     // error happens, log uncommon ones
     if (saved_errno != EINTR) {
       errno = saved_errno;
-      LOG(ERROR) << "EPollPoller::poll()";
+      LOG_RATE_LIMITED(ERROR, 10) << "EPollPoller::poll()";
     }
   }
   return now;
@@ -156,7 +157,7 @@ void EPollPoller::Update(int operation, Channel* channel) {
   int fd = channel->fd();
   if (::epoll_ctl(epollfd_, operation, fd, &event) < 0) {
     if (operation == EPOLL_CTL_DEL) {
-      LOG(ERROR) << "epoll_ctl op=" << operation << " fd=" << fd;
+      LOG_RATE_LIMITED(ERROR, 10) << "epoll_ctl op=" << operation << " fd=" << fd;
     } else {
       LOG(FATAL) << "epoll_ctl op=" << operation << " fd=" << fd;
     }
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <poll.h>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/base/type_conversion.h"
 #include "muduo-cpp11/net/channel.h"
@@ -31,7 +32,7 @@ Timestamp PollPoller::Poll(int timeout_ms, ChannelList* active_channels) {
   // XXX pollfds_ shouldn't change
   int num_events = ::poll(pollfds_.data(), pollfds_.size(), timeout_ms);
   int saved_errno = errno;
-  Timestamp now(Timestamp::Now());
+  Timestamp now(Timestamp::MonotonicNow());
   if (num_events > 0) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
     if (VLOG_IS_ON(1)) {
@@ -49,9 +50,9 @@ Timestamp PollPoller::Poll(int timeout_ms, ChannelList* active_channels) {
     if (saved_errno != EINTR) {
       errno = saved_errno;
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-      LOG(ERROR) << "PollPoller::poll()";
+      LOG_RATE_LIMITED(ERROR, 10) << "PollPoller::poll()";
 #else
-      LogError("PollPoller::poll()");
+      LogRateLimited(LogError, 10, "PollPoller::poll()");
 #endif
     }
   }
@@ -24,7 +24,16 @@ namespace muduo_cpp11 {
 namespace net {
 
 Socket::~Socket() {
-  sockets::Close(sockfd_);
+  if (sockfd_ >= 0) {
+    sockets::Close(sockfd_);
+  }
+}
+
+void Socket::Reset(int sockfd) {
+  if (sockfd_ >= 0) {
+    sockets::Close(sockfd_);
+  }
+  sockfd_ = sockfd;
 }
 
 bool Socket::GetTcpInfo(struct tcp_info* tcpi) const {
@@ -42,6 +42,10 @@ class Socket {
 
   int fd() const { return sockfd_; }
 
+  /// Closes the owned sockfd (if any) and takes over @c sockfd.
+  /// Pass -1 to just release the descriptor, used by TcpConnectionPool.
+  void Reset(int sockfd);
+
   // return true if success.
   bool GetTcpInfo(struct tcp_info*) const;
   bool GetTcpInfoString(char* buf, int len) const;
@@ -80,7 +84,7 @@ class Socket {
   void set_keepalive(bool on);
 
  private:
-  const int sockfd_;
+  int sockfd_;
 
   DISABLE_COPY_AND_ASSIGN(Socket);
 };
@@ -14,12 +14,18 @@
 #include <fcntl.h>
 #include <stdio.h>  // snprintf
 #include <strings.h>  // bzero
+#if defined(__MACH__)
+#include <sys/types.h>
+#else
+#include <sys/sendfile.h>
+#endif
 #include <sys/socket.h>
 #if defined(__MACH__) || defined(__ANDROID_API__)
 #include <sys/uio.h>  // readv
 #endif
 #include <unistd.h>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/base/type_conversion.h"
 #include "muduo-cpp11/net/endian.h"
@@ -122,9 +128,9 @@ int Accept(int sockfd, struct sockaddr_in* addr) {
     int saved_errno = errno;
 
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-    LOG(ERROR) << "Socket::Accept";
+    LOG_RATE_LIMITED(ERROR, 10) << "Socket::Accept";
 #else
-    LogError("Socket::Accept");
+    LogRateLimited(LogError, 10, "Socket::Accept");
 #endif
 
     switch (saved_errno) {
@@ -182,12 +188,30 @@ ssize_t Write(int sockfd, const void *buf, size_t count) {
   return ::write(sockfd, buf, count);
 }
 
+ssize_t SendFile(int sockfd, int fd, int64_t* offset, size_t count) {
+#if defined(__MACH__)
+  off_t len = count;
+  if (::sendfile(fd, sockfd, *offset, &len, NULL, 0) < 0 && len == 0) {
+    return -1;
+  }
+  *offset += len;
+  return len;
+#else
+  off_t off = *offset;
+  ssize_t n = ::sendfile(sockfd, fd, &off, count);
+  if (n > 0) {
+    *offset = off;
+  }
+  return n;
+#endif
+}
+
 void Close(int sockfd) {
   if (::close(sockfd) < 0) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-    LOG(ERROR) << "sockets::Close";
+    LOG_RATE_LIMITED(ERROR, 10) << "sockets::Close";
 #else
-    LogError("sockets::Close");
+    LogRateLimited(LogError, 10, "sockets::Close");
 #endif
   }
 }
@@ -195,9 +219,9 @@ void Close(int sockfd) {
 void ShutdownWrite(int sockfd) {
   if (::shutdown(sockfd, SHUT_WR) < 0) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-    LOG(ERROR) << "sockets::ShutdownWrite";
+    LOG_RATE_LIMITED(ERROR, 10) << "sockets::ShutdownWrite";
 #else
-    LogError("sockets::ShutdownWrite");
+    LogRateLimited(LogError, 10, "sockets::ShutdownWrite");
 #endif
   }
 }
@@ -251,9 +275,9 @@ struct sockaddr_in GetLocalAddr(int sockfd) {
   socklen_t addrlen = static_cast<socklen_t>(sizeof localaddr);
   if (::getsockname(sockfd, sockaddr_cast(&localaddr), &addrlen) < 0) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-    LOG(ERROR) << "sockets::GetLocalAddr";
+    LOG_RATE_LIMITED(ERROR, 10) << "sockets::GetLocalAddr";
 #else
-    LogError("sockets::GetLocalAddr");
+    LogRateLimited(LogError, 10, "sockets::GetLocalAddr");
 #endif
   }
   return localaddr;
@@ -265,9 +289,9 @@ struct sockaddr_in GetPeerAddr(int sockfd) {
   socklen_t addrlen = static_cast<socklen_t>(sizeof peeraddr);
   if (::getpeername(sockfd, sockaddr_cast(&peeraddr), &addrlen) < 0) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-    LOG(ERROR) << "sockets::GetPeerAddr";
+    LOG_RATE_LIMITED(ERROR, 10) << "sockets::GetPeerAddr";
 #else
-    LogError("sockets::GetPeerAddr");
+    LogRateLimited(LogError, 10, "sockets::GetPeerAddr");
 #endif
   }
   return peeraddr;
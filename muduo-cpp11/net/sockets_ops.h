@@ -13,6 +13,7 @@
 #define MUDUO_CPP11_NET_SOCKETS_OPS_H_
 
 #include <arpa/inet.h>
+#include <stdint.h>
 
 namespace muduo_cpp11 {
 namespace net {
@@ -33,6 +34,9 @@ int Accept(int sockfd, struct sockaddr_in* addr);
 ssize_t Read(int sockfd, void *buf, size_t count);
 ssize_t Readv(int sockfd, const struct iovec *iov, int iovcnt);
 ssize_t Write(int sockfd, const void *buf, size_t count);
+/// Writes up to @count bytes of @fd from *@offset with sendfile(2),
+/// advancing *@offset by the bytes written.
+ssize_t SendFile(int sockfd, int fd, int64_t* offset, size_t count);
 void Close(int sockfd);
 void ShutdownWrite(int sockfd);
 
@@ -43,6 +43,9 @@ void RemoveConnection(EventLoop* loop, const TcpConnectionPtr& conn) {
 void RemoveConnector(const ConnectorPtr& connector) {
 }
 
+// in tcp_server.cpp
+void ReleaseConnection(const TcpConnectionPtr& conn);
+
 }  // namespace detail
 
 TcpClient::TcpClient(EventLoop* loop,
@@ -84,6 +87,12 @@ TcpClient::~TcpClient() {
     loop_->RunInLoop(std::bind(&TcpConnection::set_close_callback, conn, cb));
     if (unique) {
       conn->ForceClose();
+    } else {
+      loop_->RunInLoop(std::bind(&TcpConnection::ConnectOrphaned, conn));
+    }
+    if (loop_->IsInLoopThread()) {
+      // We may be inside one of its events, free it only after them.
+      loop_->QueueInLoop(std::bind(&detail::ReleaseConnection, conn));
     }
   } else {
     connector_->Stop();
@@ -117,6 +126,15 @@ void TcpClient::Disconnect() {
 void TcpClient::Stop() {
   connect_ = false;
   connector_->Stop();
+
+  StopCallback cb;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cb = stop_callback_;
+  }
+  if (cb) {
+    loop_->RunInLoop(cb);
+  }
 }
 
 void TcpClient::NewConnection(int sockfd) {
@@ -137,7 +155,11 @@ void TcpClient::NewConnection(int sockfd) {
                                           peer_addr));
 
   conn->set_connection_callback(connection_callback_);
-  conn->set_message_callback(message_callback_);
+  if (borrowed_message_callback_) {
+    conn->set_borrowed_message_callback(borrowed_message_callback_);
+  } else {
+    conn->set_message_callback(message_callback_);
+  }
   conn->set_write_complete_callback(write_complete_callback_);
   conn->set_close_callback(std::bind(&TcpClient::RemoveConnection, this, std::placeholders::_1));  // FIXME: unsafe
 
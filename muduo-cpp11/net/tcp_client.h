@@ -13,6 +13,7 @@
 #define MUDUO_CPP11_NET_TCP_CLIENT_H_
 
 #include <atomic>
+#include <functional>
 #include <mutex>
 #include <string>
 
@@ -27,6 +28,8 @@ typedef std::shared_ptr<Connector> ConnectorPtr;
 
 class TcpClient {
  public:
+  typedef std::function<void ()> StopCallback;
+
   // TcpClient(EventLoop* loop);
   // TcpClient(EventLoop* loop, const std::string& host, uint16_t port);
   TcpClient(EventLoop* loop,
@@ -55,12 +58,39 @@ class TcpClient {
     connection_callback_ = cb;
   }
 
+  /// Not thread safe.
+  const ConnectionCallback& connection_callback() const {
+    return connection_callback_;
+  }
+
+  /// Set callback run in loop thread after Stop(), e.g. to stop waiting
+  /// for a connection which will not come.
+  /// Thread safe.
+  void set_stop_callback(const StopCallback& cb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_callback_ = cb;
+  }
+
+  /// Thread safe.
+  StopCallback stop_callback() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_callback_;
+  }
+
   /// Set message callback.
   /// Not thread safe.
   void set_message_callback(const MessageCallback& cb) {
     message_callback_ = cb;
   }
 
+  /// Set message callback lending the connection, see TcpConnectionRef
+  /// for what the callback must not do with it.
+  /// Takes precedence over the message callback.
+  /// Not thread safe.
+  void set_borrowed_message_callback(const BorrowedMessageCallback& cb) {
+    borrowed_message_callback_ = cb;
+  }
+
   /// Set write complete callback.
   /// Not thread safe.
   void set_write_complete_callback(const WriteCompleteCallback& cb) {
@@ -80,6 +110,7 @@ class TcpClient {
 
   ConnectionCallback connection_callback_;
   MessageCallback message_callback_;
+  BorrowedMessageCallback borrowed_message_callback_;
   WriteCompleteCallback write_complete_callback_;
 
   std::atomic<bool> retry_;
@@ -89,6 +120,7 @@ class TcpClient {
   int next_conn_id_;
   mutable std::mutex mutex_;
   TcpConnectionPtr connection_;  // @GuardedBy mutex_
+  StopCallback stop_callback_;  // @GuardedBy mutex_
 
   DISABLE_COPY_AND_ASSIGN(TcpClient);
 };
@@ -11,9 +11,11 @@
 
 #include <errno.h>
 
+#include <algorithm>
 #include <functional>
 #include <string>
 
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/base/weak_callback.h"
 #include "muduo-cpp11/net/channel.h"
@@ -26,6 +28,16 @@ using std::string;
 namespace muduo_cpp11 {
 namespace net {
 
+namespace {
+
+const size_t kMaxRecycledBufferSize = 64 * 1024;
+
+// A throttled connection waits for this many egress tokens, or a quarter
+// second worth on slow limits, rather than write every byte it earns.
+const size_t kMaxEgressQuantum = 16 * 1024;
+
+}  // namespace
+
 void DefaultConnectionCallback(const TcpConnectionPtr& conn) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
   VLOG(1) << conn->local_address().ToIpPort() << " -> "
@@ -54,11 +66,13 @@ TcpConnection::TcpConnection(EventLoop* loop,
       channel_(new Channel(loop, sockfd)),
       local_addr_(local_addr),
       peer_addr_(peer_addr),
-      high_watermark_(64 * 1024 * 1024) {
-  channel_->set_read_callback(std::bind(&TcpConnection::HandleRead, this, std::placeholders::_1));
-  channel_->set_write_callback(std::bind(&TcpConnection::HandleWrite, this));
-  channel_->set_close_callback(std::bind(&TcpConnection::HandleClose, this));
-  channel_->set_error_callback(std::bind(&TcpConnection::HandleError, this));
+      high_watermark_(64 * 1024 * 1024),
+      input_high_watermark_(0),
+      read_paused_(0),
+      peer_paused_(false),
+      egress_quantum_(1),
+      write_throttled_(false) {
+  channel_->set_handler(this);
 
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
   DLOG(INFO) << "TcpConnection::ctor[" <<  name_ << "] at " << this << " fd=" << sockfd;
@@ -74,6 +88,59 @@ TcpConnection::~TcpConnection() {
   assert(state_ == kDisconnected);
 }
 
+void TcpConnection::Reinit(const string& name_arg,
+                           int sockfd,
+                           const InetAddress& local_addr,
+                           const InetAddress& peer_addr) {
+  assert(state_ == kDisconnected);
+  name_ = name_arg;
+  state_ = kConnecting;
+  socket_->Reset(sockfd);
+  channel_->Reset(sockfd);
+  local_addr_ = local_addr;
+  peer_addr_ = peer_addr;
+  high_watermark_ = 64 * 1024 * 1024;
+  input_high_watermark_ = 0;
+  read_paused_ = 0;
+  peer_paused_ = false;
+  ingress_limiter_ = TokenBucket();
+  egress_limiter_ = TokenBucket();
+  egress_quantum_ = 1;
+  write_throttled_ = false;
+
+  socket_->set_keepalive(true);
+}
+
+void TcpConnection::Recycle() {
+  assert(state_ == kDisconnected);
+  socket_->Reset(-1);
+  channel_->Reset(-1);
+
+  // Keep the buffers' capacity unless a big message has bloated them.
+  input_buffer_.RetrieveAll();
+  output_buffer_.RetrieveAll();
+  pending_files_.clear();
+  if (input_buffer_.InternalCapacity() > kMaxRecycledBufferSize) {
+    input_buffer_.Shrink(0);
+  }
+  if (output_buffer_.InternalCapacity() > kMaxRecycledBufferSize) {
+    output_buffer_.Shrink(0);
+  }
+
+  // User callbacks may capture resources, do not hold them in the pool.
+  connection_callback_ = ConnectionCallback();
+  message_callback_ = MessageCallback();
+  borrowed_message_callback_ = BorrowedMessageCallback();
+  write_complete_callback_ = WriteCompleteCallback();
+  high_watermark_callback_ = HighWaterMarkCallback();
+  close_callback_ = CloseCallback();
+  backpressure_peer_.reset();
+
+#if !defined(__MACH__) && !defined(__ANDROID_API__)
+  context_ = boost::any();
+#endif
+}
+
 bool TcpConnection::GetTcpInfo(struct tcp_info* tcpi) const {
   return socket_->GetTcpInfo(tcpi);
 }
@@ -119,6 +186,24 @@ void TcpConnection::Send(Buffer* buf) {
   }
 }
 
+void TcpConnection::SendFile(int fd,
+                             int64_t offset,
+                             size_t length,
+                             const std::shared_ptr<void>& owner) {
+  if (state_ == kConnected) {
+    if (loop_->IsInLoopThread()) {
+      SendFileInLoop(fd, offset, length, owner);
+    } else {
+      loop_->RunInLoop(std::bind(&TcpConnection::SendFileInLoop,
+                                 this,  // FIXME
+                                 fd,
+                                 offset,
+                                 length,
+                                 owner));
+    }
+  }
+}
+
 void TcpConnection::SendInLoop(const StringPiece& message) {
   SendInLoop(message.data(), message.size());
 }
@@ -132,17 +217,23 @@ void TcpConnection::SendInLoop(const void* data, size_t len) {
 
   if (state_ == kDisconnected) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-    LogWarn("disconnected, give up writing");
+    LogRateLimited(LogWarn, 10, "disconnected, give up writing");
 #else
-    LOG(WARNING) << "disconnected, give up writing";
+    LOG_RATE_LIMITED(WARNING, 10) << "disconnected, give up writing";
 #endif
     return;
   }
 
   // if nothing in output queue, try writing directly
-  if (!channel_->IsWriting() && output_buffer_.ReadableBytes() == 0) {
-    nwrote = sockets::Write(channel_->fd(), data, len);
+  if (!channel_->IsWriting() && !write_throttled_ &&
+      output_buffer_.ReadableBytes() == 0 && pending_files_.empty()) {
+    size_t allowed = egress_limiter_.enabled() ? EgressAllowance(len) : len;
+    nwrote = allowed > 0 ? sockets::Write(channel_->fd(), data, allowed) : 0;
     if (nwrote >= 0) {
+      if (egress_limiter_.enabled()) {
+        egress_limiter_.Consume(nwrote);
+      }
+      last_active_time_ = loop_->cached_now();
       remaining = len - nwrote;
       if (remaining == 0 && write_complete_callback_) {
         loop_->QueueInLoop(
@@ -152,9 +243,9 @@ void TcpConnection::SendInLoop(const void* data, size_t len) {
       nwrote = 0;
       if (errno != EWOULDBLOCK) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-        LogError("TcpConnection::SendInLoop");
+        LogRateLimited(LogError, 10, "TcpConnection::SendInLoop");
 #else
-        LOG(ERROR) << "TcpConnection::SendInLoop";
+        LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::SendInLoop";
 #endif
         if (errno == EPIPE || errno == ECONNRESET) {  // FIXME: any others?
           fault_error = true;
@@ -167,22 +258,96 @@ void TcpConnection::SendInLoop(const void* data, size_t len) {
 
   if (!fault_error && remaining > 0) {
     size_t old_len = output_buffer_.ReadableBytes();
-    if (old_len + remaining >= high_watermark_ &&
-        old_len < high_watermark_ &&
-        high_watermark_callback_) {
-      loop_->QueueInLoop(std::bind(high_watermark_callback_,
-                                   shared_from_this(),
-                                   old_len + remaining));
+    if (old_len + remaining >= high_watermark_ && old_len < high_watermark_) {
+      if (high_watermark_callback_) {
+        loop_->QueueInLoop(std::bind(high_watermark_callback_,
+                                     shared_from_this(),
+                                     old_len + remaining));
+      }
+
+      if (!peer_paused_) {
+        TcpConnectionPtr peer(backpressure_peer_.lock());
+        if (peer) {
+          peer->PauseRead(kPausedByPeer);
+          peer_paused_ = true;
+        }
+      }
     }
 
     output_buffer_.Append(static_cast<const char*>(data) + nwrote, remaining);
 
-    if (!channel_->IsWriting()) {
+    if (egress_limiter_.enabled() && EgressAllowance(PendingOutputBytes()) == 0) {
+      ThrottleWrite();
+    } else if (!channel_->IsWriting() && !write_throttled_) {
       channel_->EnableWriting();
     }
   }
 }
 
+void TcpConnection::SendFileInLoop(int fd,
+                                   int64_t offset,
+                                   size_t length,
+                                   const std::shared_ptr<void>& owner) {
+  loop_->AssertInLoopThread();
+  if (state_ == kDisconnected) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+    LogRateLimited(LogWarn, 10, "disconnected, give up sending file");
+#else
+    LOG_RATE_LIMITED(WARNING, 10) << "disconnected, give up sending file";
+#endif
+    return;
+  }
+  if (length == 0) {
+    return;
+  }
+
+  // if nothing in output queue, try sending directly
+  if (!channel_->IsWriting() && !write_throttled_ &&
+      output_buffer_.ReadableBytes() == 0 && pending_files_.empty()) {
+    size_t allowed = egress_limiter_.enabled() ? EgressAllowance(length) : length;
+    ssize_t n = allowed > 0 ? sockets::SendFile(channel_->fd(), fd, &offset, allowed) : 0;
+    if (n >= 0) {
+      if (egress_limiter_.enabled()) {
+        egress_limiter_.Consume(n);
+      }
+      last_active_time_ = loop_->cached_now();
+      length -= n;
+      if (length == 0) {
+        if (write_complete_callback_) {
+          loop_->QueueInLoop(std::bind(write_complete_callback_, shared_from_this()));
+        }
+        return;
+      }
+    } else if (errno != EWOULDBLOCK) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+      LogRateLimited(LogError, 10, "TcpConnection::SendFileInLoop");
+#else
+      LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::SendFileInLoop";
+#endif
+      if (errno == EPIPE || errno == ECONNRESET) {
+        return;
+      }
+    }
+  }
+
+  PendingFile file;
+  file.fd = fd;
+  file.offset = offset;
+  file.remaining = length;
+  file.ahead = output_buffer_.ReadableBytes();
+  for (size_t i = 0; i < pending_files_.size(); ++i) {
+    file.ahead -= pending_files_[i].ahead;
+  }
+  file.owner = owner;
+  pending_files_.push_back(file);
+
+  if (egress_limiter_.enabled() && EgressAllowance(PendingOutputBytes()) == 0) {
+    ThrottleWrite();
+  } else if (!channel_->IsWriting() && !write_throttled_) {
+    channel_->EnableWriting();
+  }
+}
+
 void TcpConnection::Shutdown() {
   // FIXME: use compare and swap
   if (state_ == kConnected) {
@@ -194,7 +359,7 @@ void TcpConnection::Shutdown() {
 
 void TcpConnection::ShutdownInLoop() {
   loop_->AssertInLoopThread();
-  if (!channel_->IsWriting()) {
+  if (!channel_->IsWriting() && !write_throttled_) {
     // we are not writing
     socket_->ShutdownWrite();
   }
@@ -249,6 +414,138 @@ void TcpConnection::ForceCloseInLoop() {
   }
 }
 
+void TcpConnection::StartRead() {
+  ResumeRead(kPausedByUser | kPausedByInput);
+}
+
+void TcpConnection::StopRead() {
+  PauseRead(kPausedByUser);
+}
+
+void TcpConnection::PauseRead(int reason) {
+  if (loop_->IsInLoopThread()) {
+    PauseReadInLoop(reason);
+  } else {
+    loop_->QueueInLoop(std::bind(&TcpConnection::PauseReadInLoop, shared_from_this(), reason));
+  }
+}
+
+void TcpConnection::ResumeRead(int reason) {
+  if (loop_->IsInLoopThread()) {
+    ResumeReadInLoop(reason);
+  } else {
+    loop_->QueueInLoop(std::bind(&TcpConnection::ResumeReadInLoop, shared_from_this(), reason));
+  }
+}
+
+void TcpConnection::PauseReadInLoop(int reason) {
+  loop_->AssertInLoopThread();
+  read_paused_ |= reason;
+  // a closed channel is not reading either.
+  if (channel_->IsReading()) {
+    channel_->DisableReading();
+  }
+}
+
+void TcpConnection::ResumeReadInLoop(int reason) {
+  loop_->AssertInLoopThread();
+  read_paused_ &= ~reason;
+  if (read_paused_ == 0 &&
+      (state_ == kConnected || state_ == kDisconnecting) &&
+      !channel_->IsReading()) {
+    channel_->EnableReading();
+  }
+}
+
+void TcpConnection::set_ingress_rate_limit(double bytes_per_second) {
+  ingress_limiter_ = TokenBucket(bytes_per_second, bytes_per_second, Timestamp::MonotonicNow());
+}
+
+void TcpConnection::set_egress_rate_limit(double bytes_per_second) {
+  egress_limiter_ = TokenBucket(bytes_per_second, bytes_per_second, Timestamp::MonotonicNow());
+  egress_quantum_ = std::max(static_cast<size_t>(1),
+                             std::min(kMaxEgressQuantum, static_cast<size_t>(bytes_per_second / 4)));
+}
+
+void TcpConnection::ThrottleRead() {
+  if (!(read_paused_ & kPausedByRate)) {
+    PauseReadInLoop(kPausedByRate);
+    loop_->RunAfter(ingress_limiter_.SecondsUntilAvailable(1),
+                    MakeWeakCallback(shared_from_this(), &TcpConnection::UnthrottleRead));
+  }
+}
+
+void TcpConnection::UnthrottleRead() {
+  ResumeReadInLoop(kPausedByRate);
+}
+
+size_t TcpConnection::EgressAllowance(size_t len) {
+  size_t available = egress_limiter_.Available(loop_->cached_now());
+  return available >= std::min(len, egress_quantum_) ? std::min(len, available) : 0;
+}
+
+size_t TcpConnection::PendingOutputBytes() const {
+  size_t bytes = output_buffer_.ReadableBytes();
+  for (size_t i = 0; i < pending_files_.size(); ++i) {
+    bytes += pending_files_[i].remaining;
+  }
+  return bytes;
+}
+
+void TcpConnection::ThrottleWrite() {
+  if (!write_throttled_) {
+    write_throttled_ = true;
+    if (channel_->IsWriting()) {
+      channel_->DisableWriting();
+    }
+    size_t wanted = std::max(static_cast<size_t>(1),
+                             std::min(PendingOutputBytes(), egress_quantum_));
+    loop_->RunAfter(egress_limiter_.SecondsUntilAvailable(wanted),
+                    MakeWeakCallback(shared_from_this(), &TcpConnection::UnthrottleWrite));
+  }
+}
+
+void TcpConnection::UnthrottleWrite() {
+  loop_->AssertInLoopThread();
+  write_throttled_ = false;
+  if ((state_ == kConnected || state_ == kDisconnecting) &&
+      (output_buffer_.ReadableBytes() > 0 || !pending_files_.empty()) &&
+      !channel_->IsWriting()) {
+    channel_->EnableWriting();
+  }
+}
+
+void TcpConnection::CheckInputWatermark() {
+  size_t readable = input_buffer_.ReadableBytes();
+  if (input_high_watermark_ > 0 && readable >= input_high_watermark_) {
+    if (!(read_paused_ & kPausedByInput)) {
+      PauseReadInLoop(kPausedByInput);
+      // HandleRead() no longer runs to see a drain from a queued functor.
+      loop_->QueueInLoop(MakeWeakCallback(shared_from_this(), &TcpConnection::RecheckInputWatermark));
+    }
+  } else if ((read_paused_ & kPausedByInput) &&
+             (readable < input_high_watermark_ / 2 || input_high_watermark_ == 0)) {
+    ResumeReadInLoop(kPausedByInput);
+  }
+}
+
+void TcpConnection::RecheckInputWatermark() {
+  loop_->AssertInLoopThread();
+  if (read_paused_ & kPausedByInput) {
+    CheckInputWatermark();
+  }
+}
+
+void TcpConnection::ResumePeerIfDrained() {
+  if (output_buffer_.ReadableBytes() < high_watermark_ / 2 || state_ == kDisconnected) {
+    TcpConnectionPtr peer(backpressure_peer_.lock());
+    if (peer) {
+      peer->ResumeRead(kPausedByPeer);
+    }
+    peer_paused_ = false;
+  }
+}
+
 const char* TcpConnection::StateToString() const {
   switch (state_) {
     case kDisconnected:
@@ -272,7 +569,7 @@ void TcpConnection::ConnectEstablished() {
   loop_->AssertInLoopThread();
   assert(state_ == kConnecting);
   set_state(kConnected);
-  channel_->Tie(shared_from_this());
+  last_active_time_ = Timestamp::MonotonicNow();
   channel_->EnableReading();
 
   connection_callback_(shared_from_this());
@@ -280,7 +577,9 @@ void TcpConnection::ConnectEstablished() {
 
 void TcpConnection::ConnectDestroyed() {
   loop_->AssertInLoopThread();
-  if (state_ == kConnected) {
+  // Also when a Shutdown() or ForceClose() is still under way, e.g. when
+  // the owner is destroyed right after it.
+  if (state_ == kConnected || state_ == kDisconnecting) {
     set_state(kDisconnected);
     channel_->DisableAll();
     connection_callback_(shared_from_this());
@@ -288,20 +587,43 @@ void TcpConnection::ConnectDestroyed() {
   channel_->Remove();
 }
 
+void TcpConnection::ConnectOrphaned() {
+  loop_->AssertInLoopThread();
+  // The user may now drop the last reference inside one of my events.
+  channel_->Tie(shared_from_this());
+}
+
 void TcpConnection::HandleRead(Timestamp receive_time) {
   loop_->AssertInLoopThread();
   int saved_errno = 0;
   ssize_t n = input_buffer_.ReadFd(channel_->fd(), &saved_errno);
   if (n > 0) {
-    message_callback_(shared_from_this(), &input_buffer_, receive_time);
+    last_active_time_ = loop_->cached_now();
+    if (ingress_limiter_.enabled()) {
+      ingress_limiter_.Consume(n);
+      if (ingress_limiter_.Available(last_active_time_) == 0) {
+        ThrottleRead();
+      }
+    }
+    // The owner keeps this alive while its events are handled, even if
+    // destroyed from the callback, see the class comment, so lending it
+    // costs no reference counting.
+    if (borrowed_message_callback_) {
+      borrowed_message_callback_(TcpConnectionRef(this), &input_buffer_, receive_time);
+    } else {
+      message_callback_(shared_from_this(), &input_buffer_, receive_time);
+    }
+    if (input_high_watermark_ > 0 || (read_paused_ & kPausedByInput)) {
+      CheckInputWatermark();
+    }
   } else if (n == 0) {
     HandleClose();
   } else {
     errno = saved_errno;
 #if defined(__MACH__) || defined(__ANDROID_API__)
-    LogError("TcpConnection::HandleRead");
+    LogRateLimited(LogError, 10, "TcpConnection::HandleRead");
 #else
-    LOG(ERROR) << "TcpConnection::HandleRead";
+    LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::HandleRead";
 #endif
     HandleError();
   }
@@ -310,12 +632,49 @@ void TcpConnection::HandleRead(Timestamp receive_time) {
 void TcpConnection::HandleWrite() {
   loop_->AssertInLoopThread();
   if (channel_->IsWriting()) {
-    ssize_t n = sockets::Write(channel_->fd(),
-                               output_buffer_.Peek(),
-                               output_buffer_.ReadableBytes());
+    // Up to the next file queued by SendFile(), if any, then that file.
+    PendingFile* file = NULL;
+    size_t len = output_buffer_.ReadableBytes();
+    if (!pending_files_.empty()) {
+      len = pending_files_.front().ahead;
+      if (len == 0) {
+        file = &pending_files_.front();
+        len = file->remaining;
+      }
+    }
+    if (egress_limiter_.enabled()) {
+      len = EgressAllowance(len);
+      if (len == 0) {
+        ThrottleWrite();
+        return;
+      }
+    }
+
+    ssize_t n = file != NULL ? sockets::SendFile(channel_->fd(), file->fd, &file->offset, len)
+                             : sockets::Write(channel_->fd(), output_buffer_.Peek(), len);
     if (n > 0) {
-      output_buffer_.Retrieve(n);
-      if (output_buffer_.ReadableBytes() == 0) {
+      last_active_time_ = loop_->cached_now();
+      if (file != NULL) {
+        file->remaining -= n;
+        if (file->remaining == 0) {
+          pending_files_.pop_front();
+        }
+      } else {
+        output_buffer_.Retrieve(n);
+        if (!pending_files_.empty()) {
+          pending_files_.front().ahead -= n;
+        }
+      }
+      if (egress_limiter_.enabled()) {
+        egress_limiter_.Consume(n);
+      }
+      if (peer_paused_) {
+        ResumePeerIfDrained();
+      }
+      if (read_paused_ & kPausedByInput) {
+        CheckInputWatermark();
+      }
+      if (output_buffer_.ReadableBytes() == 0 && pending_files_.empty()) {
         channel_->DisableWriting();
         if (write_complete_callback_) {
           loop_->QueueInLoop(std::bind(write_complete_callback_, shared_from_this()));
@@ -324,11 +683,19 @@ void TcpConnection::HandleWrite() {
           ShutdownInLoop();
         }
       }
+    } else if (n == 0 && file != NULL) {
+      // The file was truncated, what is sent after it would be misread.
+#if defined(__MACH__) || defined(__ANDROID_API__)
+      LogRateLimited(LogError, 10, "TcpConnection::handleWrite file ended early");
+#else
+      LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::handleWrite file ended early";
+#endif
+      ForceCloseInLoop();
     } else {
 #if defined(__MACH__) || defined(__ANDROID_API__)
-      LogError("TcpConnection::handleWrite");
+      LogRateLimited(LogError, 10, "TcpConnection::handleWrite");
 #else
-      LOG(ERROR) << "TcpConnection::handleWrite";
+      LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::handleWrite";
 #endif
       // if (state_ == kDisconnecting) {
       //   shutdownInLoop();
@@ -352,6 +719,12 @@ void TcpConnection::HandleClose() {
   // we don't close fd, leave it to dtor, so we can find leaks easily.
   set_state(kDisconnected);
   channel_->DisableAll();
+  // Releases the files, nothing more will be written.
+  pending_files_.clear();
+
+  if (peer_paused_) {
+    ResumePeerIfDrained();
+  }
 
   TcpConnectionPtr guard_this(shared_from_this());
   connection_callback_(guard_this);
@@ -362,9 +735,9 @@ void TcpConnection::HandleClose() {
 void TcpConnection::HandleError() {
   int err = sockets::GetSocketError(channel_->fd());
 #if defined(__MACH__) || defined(__ANDROID_API__)
-  LogError("TcpConnection::HandleError [%d] - SO_ERROR = %d %s", name_.c_str(), err, strerror_tl(err).c_str());
+  LogRateLimited(LogError, 10, "TcpConnection::HandleError [%s] - SO_ERROR = %d %s", name_.c_str(), err, strerror_tl(err).c_str());
 #else
-  LOG(ERROR) << "TcpConnection::HandleError [" << name_ << "] - SO_ERROR = " << err << " " << strerror_tl(err);
+  LOG_RATE_LIMITED(ERROR, 10) << "TcpConnection::HandleError [" << name_ << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 #endif
 }
 
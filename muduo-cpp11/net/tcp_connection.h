@@ -12,7 +12,11 @@
 #ifndef MUDUO_CPP11_NET_TCP_CONNECTION_H_
 #define MUDUO_CPP11_NET_TCP_CONNECTION_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
 
@@ -22,8 +26,10 @@
 
 #include "muduo-cpp11/base/macros.h"
 #include "muduo-cpp11/base/string_piece.h"
+#include "muduo-cpp11/base/token_bucket.h"
 #include "muduo-cpp11/net/callbacks.h"
 #include "muduo-cpp11/net/buffer.h"
+#include "muduo-cpp11/net/channel_handler.h"
 #include "muduo-cpp11/net/inet_address.h"
 
 // struct tcp_info is in <netinet/tcp.h>
@@ -35,12 +41,22 @@ namespace net {
 class Channel;
 class EventLoop;
 class Socket;
+class TcpConnectionPool;
 
 ///
 /// TCP connection, for both client and server usage.
 ///
 /// This is an interface class, so don't expose too much details.
-class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
+///
+/// Its channel's events are dispatched without locking a weak_ptr: the
+/// owner, TcpServer or TcpClient, drops it only from a queued functor,
+/// also when destroyed from one of its callbacks, and queued functors run
+/// after the events of the iteration, so it outlives any event being
+/// handled. A TcpClient destroyed while the connection stays up leaves it
+/// to the user, whose last reference may go in any event, so only then
+/// the channel is tied, see ConnectOrphaned().
+class TcpConnection : public std::enable_shared_from_this<TcpConnection>,
+                      private ChannelHandler {
  public:
   /// Constructs a TcpConnection with a connected sockfd
   ///
@@ -76,6 +92,12 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
     return state_ == kDisconnected;
   }
 
+  /// Monotonic poll time (EventLoop::cached_now()) of the last read or
+  /// write, NOT thread safe.
+  Timestamp last_active_time() const {
+    return last_active_time_;
+  }
+
   // return true if success.
   bool GetTcpInfo(struct tcp_info*) const;
   std::string GetTcpInfoString() const;
@@ -84,6 +106,12 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   void Send(const StringPiece& message);
   void Send(Buffer* message);  // this one will swap data
 
+  /// Sends @length bytes of the file @fd from @offset with sendfile(2),
+  /// after what was sent before and ahead of what is sent after, thread
+  /// safe. @fd must stay open until then, or until the connection closes;
+  /// @owner is held as long, e.g. the object which closes @fd.
+  void SendFile(int fd, int64_t offset, size_t length, const std::shared_ptr<void>& owner);
+
   // NOT thread safe, no simultaneous calling
   void Shutdown();
 
@@ -94,6 +122,42 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   void ForceCloseWithDelay(double seconds);
   void SetTcpNoDelay(bool on);
 
+  /// Resumes/pauses reading from the socket, thread safe.
+  /// StartRead() also clears a pause caused by the input watermark.
+  void StartRead();
+  void StopRead();
+
+  /// NOT thread safe, may race with StartRead/StopRead.
+  bool IsReading() const {
+    return read_paused_ == 0;
+  }
+
+  /// Pauses reading automatically once @c input_buffer() holds
+  /// @c high_watermark bytes after the message callback returns, and
+  /// resumes when it drops under half of that, as seen after a write or
+  /// by the functors queued to the loop meanwhile. Call StartRead() once
+  /// drained later than that, e.g. by another thread. 0 disables it.
+  /// It should be larger than the biggest message of the protocol.
+  void set_input_high_watermark(size_t high_watermark) {
+    input_high_watermark_ = high_watermark;
+  }
+
+  /// Links @c peer for backpressure: peer stops reading while output of
+  /// this connection is above the high watermark (see
+  /// set_high_watermark_callback), and resumes when half of it drains.
+  /// Typically used by proxies, in both directions.
+  void set_backpressure_peer(const TcpConnectionPtr& peer) {
+    backpressure_peer_ = peer;
+  }
+
+  /// Limits the average bytes per second read from/written to the socket,
+  /// allowing bursts of one second worth of bytes. 0 means unlimited.
+  /// Reading pauses when ingress tokens run out, output stays in
+  /// @c output_buffer() when egress tokens run out, a timer resumes both.
+  /// NOT thread safe, call it in loop thread, e.g. in connection callback.
+  void set_ingress_rate_limit(double bytes_per_second);
+  void set_egress_rate_limit(double bytes_per_second);
+
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
   void set_context(const boost::any& context) {
     context_ = context;
@@ -112,8 +176,16 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
     connection_callback_ = cb;
   }
 
+  /// Replaces the borrowed message callback.
   void set_message_callback(const MessageCallback& cb) {
     message_callback_ = cb;
+    borrowed_message_callback_ = BorrowedMessageCallback();
+  }
+
+  /// Replaces the message callback.
+  void set_borrowed_message_callback(const BorrowedMessageCallback& cb) {
+    borrowed_message_callback_ = cb;
+    message_callback_ = MessageCallback();
   }
 
   void set_write_complete_callback(const WriteCompleteCallback& cb) {
@@ -146,44 +218,108 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   // called when TcpServer has removed me from its map
   void ConnectDestroyed();  // should be called only once
 
+  // called when TcpClient drops me while I stay connected
+  void ConnectOrphaned();
+
  private:
+  friend class TcpConnectionPool;
+
   enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
 
-  void HandleRead(Timestamp receive_time);
-  void HandleWrite();
-  void HandleClose();
-  void HandleError();
+  // Reading is enabled only if no one asks for pausing.
+  enum ReadPauseReason {
+    kPausedByUser = 1,
+    kPausedByInput = 2,
+    kPausedByPeer = 4,
+    kPausedByRate = 8,
+  };
+
+  // Rebinds a recycled connection to a newly accepted sockfd.
+  void Reinit(const std::string& name,
+              int sockfd,
+              const InetAddress& local_addr,
+              const InetAddress& peer_addr);
+
+  // Closes the socket and drops per-connection state, so that the object
+  // can be cached by TcpConnectionPool. Channel callbacks are kept.
+  void Recycle();
+
+  // ChannelHandler
+  virtual void HandleRead(Timestamp receive_time);
+  virtual void HandleWrite();
+  virtual void HandleClose();
+  virtual void HandleError();
 
   // void SendInLoop(std::string&& message);
   void SendInLoop(const StringPiece& message);
   void SendInLoop(const void* message, size_t len);
+  void SendFileInLoop(int fd, int64_t offset, size_t length, const std::shared_ptr<void>& owner);
   void ShutdownInLoop();
   // void ShutdownAndForceCloseInLoop(double seconds);
   void ForceCloseInLoop();
 
+  void PauseRead(int reason);  // thread safe
+  void ResumeRead(int reason);  // thread safe
+  void PauseReadInLoop(int reason);
+  void ResumeReadInLoop(int reason);
+  void CheckInputWatermark();
+  void RecheckInputWatermark();
+  void ThrottleRead();
+  void UnthrottleRead();
+  // The egress tokens to spend now on @len bytes, 0 to wait for more.
+  size_t EgressAllowance(size_t len);
+  size_t PendingOutputBytes() const;
+  void ThrottleWrite();
+  void UnthrottleWrite();
+  void ResumePeerIfDrained();
+
   void set_state(StateE s) { state_ = s; }
   const char* StateToString() const;
 
   EventLoop* loop_;
-  const std::string name_;
+  std::string name_;  // not const, reassigned by Reinit()
   std::atomic<StateE> state_;
 
   // we don't expose those classes to client.
   std::unique_ptr<Socket> socket_;
   std::unique_ptr<Channel> channel_;
-  const InetAddress local_addr_;
-  const InetAddress peer_addr_;
+  InetAddress local_addr_;
+  InetAddress peer_addr_;
 
   ConnectionCallback connection_callback_;
   MessageCallback message_callback_;
+  BorrowedMessageCallback borrowed_message_callback_;
   WriteCompleteCallback write_complete_callback_;
   HighWaterMarkCallback high_watermark_callback_;
   CloseCallback close_callback_;
 
+  Timestamp last_active_time_;
   size_t high_watermark_;
+  size_t input_high_watermark_;
+  int read_paused_;  // bitmask of ReadPauseReason
+  std::weak_ptr<TcpConnection> backpressure_peer_;
+  bool peer_paused_;
+
+  TokenBucket ingress_limiter_;
+  TokenBucket egress_limiter_;
+  // The least worth a write while throttled, unless less is pending.
+  size_t egress_quantum_;
+  bool write_throttled_;
+
   Buffer input_buffer_;
   Buffer output_buffer_;  // FIXME: use list<Buffer> as output buffer.
 
+  // A file queued by SendFile() goes out after @ahead more bytes of
+  // output_buffer_, counted from the end of the file before it.
+  struct PendingFile {
+    int fd;
+    int64_t offset;
+    size_t remaining;
+    size_t ahead;
+    std::shared_ptr<void> owner;
+  };
+  std::deque<PendingFile> pending_files_;
+
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
   boost::any context_;
 #endif
@@ -196,6 +332,10 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
 
+inline TcpConnectionPtr TcpConnectionRef::Retain() const {
+  return conn_->shared_from_this();
+}
+
 }  // namespace net
 }  // namespace muduo_cpp11
 
@@ -0,0 +1,199 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+
+#include "muduo-cpp11/net/tcp_connection_pool.h"
+
+#include <assert.h>
+
+#include <new>
+#include <string>
+
+#include "muduo-cpp11/net/inet_address.h"
+#include "muduo-cpp11/net/tcp_connection.h"
+
+using std::string;
+
+namespace muduo_cpp11 {
+namespace net {
+
+/// Deleter of pooled connections, hands the object back to its pool.
+/// The pool is kept alive by the BlockAllocator stored in the same
+/// control block, so a raw pointer is enough here. That reference would
+/// leak the pool once the connection is cached, were the cache not
+/// emptied by Shutdown().
+class TcpConnectionPool::Recycler {
+ public:
+  explicit Recycler(TcpConnectionPool* pool)
+      : pool_(pool) {
+  }
+
+  void operator()(TcpConnection* conn) const {
+    pool_->Release(conn);
+  }
+
+ private:
+  TcpConnectionPool* pool_;
+};
+
+/// Allocates shared_ptr control blocks from the pool's free list.
+template<typename T>
+class TcpConnectionPool::BlockAllocator {
+ public:
+  typedef T value_type;
+
+  explicit BlockAllocator(const std::shared_ptr<TcpConnectionPool>& pool)
+      : pool_(pool) {
+  }
+
+  template<typename U>
+  BlockAllocator(const BlockAllocator<U>& other)
+      : pool_(other.pool_) {
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool_->AllocateBlock(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    pool_->DeallocateBlock(p, n * sizeof(T));
+  }
+
+  template<typename U>
+  bool operator==(const BlockAllocator<U>& other) const {
+    return pool_ == other.pool_;
+  }
+
+  template<typename U>
+  bool operator!=(const BlockAllocator<U>& other) const {
+    return pool_ != other.pool_;
+  }
+
+ private:
+  template<typename U> friend class BlockAllocator;
+
+  std::shared_ptr<TcpConnectionPool> pool_;
+};
+
+TcpConnectionPool::TcpConnectionPool(EventLoop* loop, size_t max_cached)
+    : loop_(loop),
+      max_cached_(max_cached),
+      block_size_(0),
+      shut_down_(false),
+      num_created_(0),
+      num_reused_(0) {
+  free_connections_.reserve(max_cached_);
+  free_blocks_.reserve(max_cached_);
+}
+
+TcpConnectionPool::~TcpConnectionPool() {
+  for (size_t i = 0; i < free_connections_.size(); ++i) {
+    delete free_connections_[i];
+  }
+  for (size_t i = 0; i < free_blocks_.size(); ++i) {
+    ::operator delete(free_blocks_[i]);
+  }
+}
+
+TcpConnectionPtr TcpConnectionPool::Acquire(const string& name,
+                                            int sockfd,
+                                            const InetAddress& local_addr,
+                                            const InetAddress& peer_addr) {
+  TcpConnection* conn = NULL;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_connections_.empty()) {
+      conn = free_connections_.back();
+      free_connections_.pop_back();
+    }
+  }
+
+  if (conn) {
+    conn->Reinit(name, sockfd, local_addr, peer_addr);
+    ++num_reused_;
+  } else {
+    conn = new TcpConnection(loop_, name, sockfd, local_addr, peer_addr);
+    ++num_created_;
+  }
+
+  return TcpConnectionPtr(conn,
+                          Recycler(this),
+                          BlockAllocator<TcpConnection>(shared_from_this()));
+}
+
+size_t TcpConnectionPool::cached() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return free_connections_.size();
+}
+
+void TcpConnectionPool::Shutdown() {
+  std::vector<TcpConnection*> connections;
+  std::vector<void*> blocks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shut_down_ = true;
+    connections.swap(free_connections_);
+    blocks.swap(free_blocks_);
+  }
+
+  // Deleting a connection may deallocate its last control block, and so
+  // drop a reference to this pool: keep it alive until done.
+  std::shared_ptr<TcpConnectionPool> guard(shared_from_this());
+  for (size_t i = 0; i < connections.size(); ++i) {
+    delete connections[i];
+  }
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    ::operator delete(blocks[i]);
+  }
+}
+
+void TcpConnectionPool::Release(TcpConnection* conn) {
+  // A connection which never got established can not be reused,
+  // let the destructor complain about it.
+  if (!conn->disconnected()) {
+    delete conn;
+    return;
+  }
+
+  conn->Recycle();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!shut_down_ && free_connections_.size() < max_cached_) {
+      free_connections_.push_back(conn);
+      conn = NULL;
+    }
+  }
+
+  delete conn;
+}
+
+void* TcpConnectionPool::AllocateBlock(size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (block_size_ == 0) {
+      block_size_ = size;
+    }
+    if (size == block_size_ && !free_blocks_.empty()) {
+      void* block = free_blocks_.back();
+      free_blocks_.pop_back();
+      return block;
+    }
+  }
+  return ::operator new(size);
+}
+
+void TcpConnectionPool::DeallocateBlock(void* block, size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!shut_down_ && size == block_size_ && free_blocks_.size() < max_cached_) {
+      free_blocks_.push_back(block);
+      return;
+    }
+  }
+  ::operator delete(block);
+}
+
+}  // namespace net
+}  // namespace muduo_cpp11
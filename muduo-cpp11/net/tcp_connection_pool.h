@@ -0,0 +1,94 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Yifan Fan (yifan.fan.1983@gmail.com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_CPP11_NET_TCP_CONNECTION_POOL_H_
+#define MUDUO_CPP11_NET_TCP_CONNECTION_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "muduo-cpp11/base/macros.h"
+#include "muduo-cpp11/net/callbacks.h"
+
+namespace muduo_cpp11 {
+namespace net {
+
+class EventLoop;
+class InetAddress;
+class TcpConnection;
+
+///
+/// Recycles TcpConnection objects of one EventLoop.
+///
+/// A released connection keeps its Socket, Channel (with bound callbacks)
+/// and Buffer storage, so accepting a new socket costs no allocation once
+/// the pool is warm. The shared_ptr control block is allocated from the pool
+/// as well, and the pool lives as long as any control block it handed out.
+///
+/// A cached connection still pins its last control block through its
+/// enable_shared_from_this, which pins the pool: the owner must call
+/// Shutdown() before dropping it, or the pool and its cache are leaked.
+///
+/// Acquire() runs in the acceptor loop and the last reference usually drops
+/// in the I/O loop, so the free lists are guarded by an uncontended mutex.
+class TcpConnectionPool : public std::enable_shared_from_this<TcpConnectionPool> {
+ public:
+  TcpConnectionPool(EventLoop* loop, size_t max_cached);
+  ~TcpConnectionPool();
+
+  EventLoop* GetLoop() const {
+    return loop_;
+  }
+
+  /// Returns a connection bound to GetLoop(), reusing a cached object if any.
+  TcpConnectionPtr Acquire(const std::string& name,
+                           int sockfd,
+                           const InetAddress& local_addr,
+                           const InetAddress& peer_addr);
+
+  size_t cached() const;
+
+  /// Frees the cached connections and blocks and stops caching, those
+  /// still in use are freed once released. Acquire() must not be called
+  /// afterwards. Thread safe.
+  void Shutdown();
+
+  int64_t num_created() const { return num_created_.load(); }
+  int64_t num_reused() const { return num_reused_.load(); }
+
+ private:
+  class Recycler;
+  template<typename T> class BlockAllocator;
+
+  void Release(TcpConnection* conn);
+  void* AllocateBlock(size_t size);
+  void DeallocateBlock(void* block, size_t size);
+
+  EventLoop* loop_;
+  const size_t max_cached_;
+
+  mutable std::mutex mutex_;
+  std::vector<TcpConnection*> free_connections_;  // @GuardedBy mutex_
+  std::vector<void*> free_blocks_;  // @GuardedBy mutex_
+  size_t block_size_;  // @GuardedBy mutex_
+  bool shut_down_;  // @GuardedBy mutex_
+
+  std::atomic<int64_t> num_created_;
+  std::atomic<int64_t> num_reused_;
+
+  DISABLE_COPY_AND_ASSIGN(TcpConnectionPool);
+};
+
+}  // namespace net
+}  // namespace muduo_cpp11
+
+#endif  // MUDUO_CPP11_NET_TCP_CONNECTION_POOL_H_
@@ -13,18 +13,37 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
+#include "muduo-cpp11/base/binary_logging.h"
+#include "muduo-cpp11/base/log_throttle.h"
 #include "muduo-cpp11/base/logging.h"
 #include "muduo-cpp11/net/acceptor.h"
 #include "muduo-cpp11/net/event_loop.h"
 #include "muduo-cpp11/net/event_loop_thread_pool.h"
+#include "muduo-cpp11/net/idle_connection_reaper.h"
 #include "muduo-cpp11/net/sockets_ops.h"
+#include "muduo-cpp11/net/tcp_connection_pool.h"
 
 using std::string;
 
 namespace muduo_cpp11 {
 namespace net {
 
+namespace detail {
+
+void ConnectEstablished(const std::shared_ptr<IdleConnectionReaper>& reaper,
+                        const TcpConnectionPtr& conn) {
+  conn->ConnectEstablished();
+  reaper->Add(conn);
+}
+
+// Holds a connection until the functors queued before this one have run.
+void ReleaseConnection(const TcpConnectionPtr& conn) {
+}
+
+}  // namespace detail
+
 TcpServer::TcpServer(EventLoop* loop,
                      const InetAddress& listen_addr,
                      const string& name,
@@ -37,7 +56,14 @@ TcpServer::TcpServer(EventLoop* loop,
       connection_callback_(DefaultConnectionCallback),
       message_callback_(DefaultMessageCallback),
       started_(ATOMIC_FLAG_INIT),
-      next_conn_id_(1) {
+      next_conn_id_(1),
+      connection_pool_size_(0),
+      idle_timeout_(0.0),
+      ingress_rate_limit_(0.0),
+      egress_rate_limit_(0.0),
+      max_connections_(0),
+      max_connections_per_loop_(0),
+      max_connections_per_ip_(0) {
   acceptor_->set_new_connection_callback(std::bind(&TcpServer::NewConnection,
                                                    this,
                                                    std::placeholders::_1,
@@ -56,9 +82,20 @@ TcpServer::~TcpServer() {
        ++it) {
     TcpConnectionPtr conn = it->second;
     it->second.reset();
-    conn->GetLoop()->RunInLoop(std::bind(&TcpConnection::ConnectDestroyed, conn));
+    EventLoop* io_loop = conn->GetLoop();
+    io_loop->RunInLoop(std::bind(&TcpConnection::ConnectDestroyed, conn));
+    if (io_loop->IsInLoopThread()) {
+      // We may be inside one of its events, free it only after them.
+      io_loop->QueueInLoop(std::bind(&detail::ReleaseConnection, conn));
+    }
     conn.reset();
   }
+
+  for (ConnectionPoolMap::iterator it(connection_pools_.begin());
+       it != connection_pools_.end();
+       ++it) {
+    it->second->Shutdown();
+  }
 }
 
 void TcpServer::set_thread_num(int num_threads) {
@@ -75,6 +112,23 @@ void TcpServer::Start() {
   if (!started_.test_and_set()) {
     thread_pool_->Start(thread_init_callback_);
 
+    std::vector<EventLoop*> loops(thread_pool_->GetAllLoops());
+    for (size_t i = 0; i < loops.size(); ++i) {
+      if (connection_pool_size_ > 0) {
+        connection_pools_[loops[i]] =
+            std::make_shared<TcpConnectionPool>(loops[i], connection_pool_size_);
+      }
+      if (max_connections_per_loop_ > 0) {
+        loop_connections_[loops[i]] = 0;
+      }
+      if (idle_timeout_ > 0.0) {
+        std::shared_ptr<IdleConnectionReaper> reaper(
+            std::make_shared<IdleConnectionReaper>(loops[i], idle_timeout_));
+        reaper->Start();
+        idle_reapers_[loops[i]] = reaper;
+      }
+    }
+
 #if defined(__MACH__) || defined(__ANDROID_API__)
     CHECK(!acceptor_->listenning(), "Acceptor should be listenning before TcpServer Start");
 #else
@@ -87,37 +141,89 @@ void TcpServer::Start() {
 
 void TcpServer::NewConnection(int sockfd, const InetAddress& peer_addr) {
   loop_->AssertInLoopThread();
-  EventLoop* io_loop = thread_pool_->GetNextLoop();
+
+  if (max_connections_per_ip_ > 0) {
+    IpConnectionCount::const_iterator it = ip_connections_.find(peer_addr.IpNetEndian());
+    if (it != ip_connections_.end() && it->second >= max_connections_per_ip_) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+      LogRateLimited(LogWarn, 10, "TcpServer::NewConnection [%s] - too many connections from %s", name_.c_str(), peer_addr.ToIp().c_str());
+#else
+      LOG_RATE_LIMITED(WARNING, 10) << "TcpServer::NewConnection [" << name_ << "] - too many connections from " << peer_addr.ToIp();
+#endif
+      sockets::Close(sockfd);
+      return;
+    }
+  }
+
+  EventLoop* io_loop = GetNextLoop();
+  if (io_loop == NULL) {
+    // Only happens if a connection was accepted before the acceptor got
+    // disabled, e.g. limits were changed, just drop it.
+    sockets::Close(sockfd);
+    acceptor_->DisableAccepting();
+    return;
+  }
 
   char buf[32];
   snprintf(buf, sizeof buf, ":%s#%d", hostport_.c_str(), next_conn_id_);
   ++next_conn_id_;
   string conn_name = name_ + buf;
 
-#if defined(__MACH__) || defined(__ANDROID_API__)
-  LogInfo("TcpServer::NewConnection [%s] - new connection [%s] from %s", name_.c_str(), conn_name.c_str(), peer_addr.ToIpPort().c_str());
-#else
-  LOG(INFO) << "TcpServer::NewConnection [" << name_ << "] - new connection [" << conn_name << "] from " << peer_addr.ToIpPort();
-#endif
+  BINLOG(INFO, "TcpServer::NewConnection [%s] - new connection [%s] from %s", name_.c_str(), conn_name.c_str(), peer_addr.ToIpPort().c_str());
 
   InetAddress local_addr(sockets::GetLocalAddr(sockfd));
 
   // FIXME poll with zero timeout to double confirm the new connection
-  // FIXME use make_shared if necessary
-  TcpConnectionPtr conn(new TcpConnection(io_loop,
-                                          conn_name,
-                                          sockfd,
-                                          local_addr,
-                                          peer_addr));
+  TcpConnectionPtr conn;
+  ConnectionPoolMap::const_iterator pool = connection_pools_.find(io_loop);
+  if (pool != connection_pools_.end()) {
+    conn = pool->second->Acquire(conn_name, sockfd, local_addr, peer_addr);
+  } else {
+    conn = std::make_shared<TcpConnection>(io_loop,
+                                           conn_name,
+                                           sockfd,
+                                           local_addr,
+                                           peer_addr);
+  }
 
   connections_[conn_name] = conn;
+  if (max_connections_per_loop_ > 0) {
+    ++loop_connections_[io_loop];
+  }
+  if (max_connections_per_ip_ > 0) {
+    ++ip_connections_[peer_addr.IpNetEndian()];
+  }
+  if (ReachConnectionLimit()) {
+#if defined(__MACH__) || defined(__ANDROID_API__)
+    LogWarn("TcpServer::NewConnection [%s] - connection limit reached, stop accepting", name_.c_str());
+#else
+    LOG(WARNING) << "TcpServer::NewConnection [" << name_ << "] - connection limit reached, stop accepting";
+#endif
+    acceptor_->DisableAccepting();
+  }
 
   conn->set_connection_callback(connection_callback_);
-  conn->set_message_callback(message_callback_);
+  if (borrowed_message_callback_) {
+    conn->set_borrowed_message_callback(borrowed_message_callback_);
+  } else {
+    conn->set_message_callback(message_callback_);
+  }
   conn->set_write_complete_callback(write_complete_callback_);
   conn->set_close_callback(std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1));  // FIXME: unsafe
+  // safe before ConnectEstablished() runs in io_loop
+  if (ingress_rate_limit_ > 0.0) {
+    conn->set_ingress_rate_limit(ingress_rate_limit_);
+  }
+  if (egress_rate_limit_ > 0.0) {
+    conn->set_egress_rate_limit(egress_rate_limit_);
+  }
 
-  io_loop->RunInLoop(std::bind(&TcpConnection::ConnectEstablished, conn));
+  IdleReaperMap::const_iterator reaper = idle_reapers_.find(io_loop);
+  if (reaper != idle_reapers_.end()) {
+    io_loop->RunInLoop(std::bind(&detail::ConnectEstablished, reaper->second, conn));
+  } else {
+    io_loop->RunInLoop(std::bind(&TcpConnection::ConnectEstablished, conn));
+  }
 }
 
 void TcpServer::RemoveConnection(const TcpConnectionPtr& conn) {
@@ -128,18 +234,64 @@ void TcpServer::RemoveConnection(const TcpConnectionPtr& conn) {
 void TcpServer::RemoveConnectionInLoop(const TcpConnectionPtr& conn) {
   loop_->AssertInLoopThread();
 
-#if defined(__MACH__) || defined(__ANDROID_API__)
-  LogInfo("TcpServer::removeConnectionInLoop [%s] - connection %s", name_.c_str(), conn->name().c_str());
-#else
-  LOG(INFO) << "TcpServer::removeConnectionInLoop [" << name_ << "] - connection " << conn->name();
-#endif
+  BINLOG(INFO, "TcpServer::removeConnectionInLoop [%s] - connection %s", name_.c_str(), conn->name().c_str());
 
   size_t n = connections_.erase(conn->name());
   (void)n;
   assert(n == 1);
   EventLoop* io_loop = conn->GetLoop();
+
+  if (max_connections_per_loop_ > 0) {
+    assert(loop_connections_[io_loop] > 0);
+    --loop_connections_[io_loop];
+  }
+  if (max_connections_per_ip_ > 0) {
+    IpConnectionCount::iterator it = ip_connections_.find(conn->peer_address().IpNetEndian());
+    assert(it != ip_connections_.end());
+    if (--it->second == 0) {
+      ip_connections_.erase(it);
+    }
+  }
+  if (!acceptor_->accepting() && acceptor_->listenning() && !ReachConnectionLimit()) {
+    acceptor_->EnableAccepting();
+  }
+
   io_loop->QueueInLoop(std::bind(&TcpConnection::ConnectDestroyed, conn));
 }
 
+EventLoop* TcpServer::GetNextLoop() {
+  if (max_connections_per_loop_ == 0) {
+    return thread_pool_->GetNextLoop();
+  }
+
+  // round-robin, skipping the loops which are full.
+  for (size_t i = 0; i < loop_connections_.size(); ++i) {
+    EventLoop* io_loop = thread_pool_->GetNextLoop();
+    if (loop_connections_[io_loop] < max_connections_per_loop_) {
+      return io_loop;
+    }
+  }
+  return NULL;
+}
+
+bool TcpServer::ReachConnectionLimit() const {
+  if (max_connections_ > 0 && connections_.size() >= max_connections_) {
+    return true;
+  }
+
+  if (max_connections_per_loop_ > 0) {
+    for (LoopConnectionCount::const_iterator it = loop_connections_.begin();
+         it != loop_connections_.end();
+         ++it) {
+      if (it->second < max_connections_per_loop_) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
 }  // namespace net
 }  // namespace muduo_cpp11
@@ -16,6 +16,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 #include "muduo-cpp11/base/macros.h"
 #include "muduo-cpp11/net/tcp_connection.h"
@@ -26,6 +27,8 @@ namespace net {
 class Acceptor;
 class EventLoop;
 class EventLoopThreadPool;
+class IdleConnectionReaper;
+class TcpConnectionPool;
 
 ///
 /// TCP server, supports single-threaded and thread-pool models.
@@ -75,6 +78,58 @@ class TcpServer {
     thread_init_callback_ = cb;
   }
 
+  /// Keeps up to @c max_cached closed connections per I/O loop for reuse,
+  /// which saves the allocations of short-lived connections.
+  /// 0 (the default) disables pooling.
+  /// Must be called before @c Start
+  void set_connection_pool_size(size_t max_cached) {
+    connection_pool_size_ = max_cached;
+  }
+
+  /// Connection limits, 0 (the default) means unlimited.
+  ///
+  /// When @c max_connections or the per-loop limit of every loop is
+  /// reached, the server stops accepting until some connection closes,
+  /// new clients wait in the listen backlog meanwhile. Connections over
+  /// the per-IP limit are closed right after accept.
+  /// Must be called before @c Start
+  void set_max_connections(size_t max_connections) {
+    max_connections_ = max_connections;
+  }
+
+  void set_max_connections_per_loop(size_t max_connections) {
+    max_connections_per_loop_ = max_connections;
+  }
+
+  void set_max_connections_per_ip(size_t max_connections) {
+    max_connections_per_ip_ = max_connections;
+  }
+
+  /// Closes connections without any read or write for @c seconds.
+  /// Each I/O loop sweeps its own connections with one timer, so idle
+  /// connections cost no timer operations per message.
+  /// 0 (the default) disables it.
+  /// Must be called before @c Start
+  void set_idle_timeout(double seconds) {
+    idle_timeout_ = seconds;
+  }
+
+  /// Default per-connection rate limits in bytes per second,
+  /// see TcpConnection::set_ingress_rate_limit. 0 (the default) means unlimited.
+  /// Must be called before @c Start
+  void set_ingress_rate_limit(double bytes_per_second) {
+    ingress_rate_limit_ = bytes_per_second;
+  }
+
+  void set_egress_rate_limit(double bytes_per_second) {
+    egress_rate_limit_ = bytes_per_second;
+  }
+
+  /// Not thread safe, but in loop
+  size_t num_connections() const {
+    return connections_.size();
+  }
+
   /// valid after calling Start()
   std::shared_ptr<EventLoopThreadPool> thread_pool() {
     return thread_pool_;
@@ -98,6 +153,14 @@ class TcpServer {
     message_callback_ = cb;
   }
 
+  /// Set message callback lending the connection, see TcpConnectionRef
+  /// for what the callback must not do with it.
+  /// Takes precedence over the message callback.
+  /// Not thread safe.
+  void set_borrowed_message_callback(const BorrowedMessageCallback& cb) {
+    borrowed_message_callback_ = cb;
+  }
+
   /// Set write complete callback.
   /// Not thread safe.
   void set_write_complete_callback(const WriteCompleteCallback& cb) {
@@ -114,8 +177,19 @@ class TcpServer {
   /// Not thread safe, but in loop
   void RemoveConnectionInLoop(const TcpConnectionPtr& conn);
 
+  /// Not thread safe, but in loop
+  /// Returns NULL if every loop reaches max_connections_per_loop_.
+  EventLoop* GetNextLoop();
+
+  /// Not thread safe, but in loop
+  bool ReachConnectionLimit() const;
+
  private:
   typedef std::map<std::string, TcpConnectionPtr> ConnectionMap;
+  typedef std::map<EventLoop*, std::shared_ptr<TcpConnectionPool>> ConnectionPoolMap;
+  typedef std::map<EventLoop*, std::shared_ptr<IdleConnectionReaper>> IdleReaperMap;
+  typedef std::map<EventLoop*, size_t> LoopConnectionCount;
+  typedef std::unordered_map<uint32_t, size_t> IpConnectionCount;
 
   EventLoop* loop_;  // the acceptor loop
   const std::string hostport_;
@@ -126,6 +200,7 @@ class TcpServer {
 
   ConnectionCallback connection_callback_;
   MessageCallback message_callback_;
+  BorrowedMessageCallback borrowed_message_callback_;
   WriteCompleteCallback write_complete_callback_;
 
   ThreadInitCallback thread_init_callback_;
@@ -135,6 +210,23 @@ class TcpServer {
   int next_conn_id_;
   ConnectionMap connections_;
 
+  size_t connection_pool_size_;
+  ConnectionPoolMap connection_pools_;  // valid after calling Start()
+
+  double idle_timeout_;
+  IdleReaperMap idle_reapers_;  // valid after calling Start()
+
+  double ingress_rate_limit_;
+  double egress_rate_limit_;
+
+  size_t max_connections_;
+  size_t max_connections_per_loop_;
+  size_t max_connections_per_ip_;
+
+  // always in loop thread, so limits are checked without locking
+  LoopConnectionCount loop_connections_;  // valid after calling Start()
+  IpConnectionCount ip_connections_;
+
   DISABLE_COPY_AND_ASSIGN(TcpServer);
 };
 
@@ -13,6 +13,7 @@
 #define MUDUO_CPP11_NET_TIMER_H_
 
 #include <atomic>
+#include <utility>
 
 #include "muduo-cpp11/base/macros.h"
 #include "muduo-cpp11/base/timestamp.h"
@@ -26,8 +27,8 @@ namespace net {
 ///
 class Timer {
  public:
-  Timer(const TimerCallback& cb, Timestamp when, double interval)
-      : callback_(cb),
+  Timer(TimerCallback cb, Timestamp when, double interval)
+      : callback_(std::move(cb)),
         expiration_(when),
         interval_(interval),
         repeat_(interval > 0.0),
@@ -47,7 +48,7 @@ class Timer {
   static int64_t num_created() { return s_num_created_.load(); }
 
  private:
-  const TimerCallback callback_;
+  TimerCallback callback_;
   Timestamp expiration_;
   const double interval_;
   const bool repeat_;
@@ -34,13 +34,9 @@ namespace net {
 namespace detail {
 
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-struct timespec HowMuchTimeFromNow(Timestamp when) {
-  int64_t microseconds = when.microseconds_since_epoch()
-                         - Timestamp::Now().microseconds_since_epoch();
-  if (microseconds < 100) {
-    microseconds = 100;
-  }
-
+struct timespec ToTimespec(Timestamp when) {
+  // All zeros would disarm the timerfd instead of firing it.
+  int64_t microseconds = std::max<int64_t>(when.microseconds_since_epoch(), 1);
   struct timespec ts;
   ts.tv_sec = static_cast<time_t>(
       microseconds / Timestamp::kMicroSecondsPerSecond);
@@ -64,8 +60,11 @@ void ResetTimerfd(int timerfd, Timestamp expiration) {
   struct itimerspec old_value;
   bzero(&new_value, sizeof new_value);
   bzero(&old_value, sizeof old_value);
-  new_value.it_value = HowMuchTimeFromNow(expiration);
-  int ret = ::timerfd_settime(timerfd, 0, &new_value, &old_value);
+  // Expirations are CLOCK_MONOTONIC times, the clock of the timerfd, so
+  // no need to read the clock for a relative timeout. One already passed
+  // fires at once.
+  new_value.it_value = ToTimespec(expiration);
+  int ret = ::timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &new_value, &old_value);
   if (ret) {
     LOG(ERROR) << "timerfd_settime()";
   }
@@ -93,8 +92,7 @@ TimerQueue::TimerQueue(EventLoop* loop)
       timers_(),
       calling_expired_timers_(false) {
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-  timerfd_channel_.set_read_callback(
-      std::bind(&TimerQueue::HandleRead, this));
+  timerfd_channel_.set_handler(this);
   // we are always reading the timerfd, we disarm it with timerfd_settime.
   timerfd_channel_.EnableReading();
 #endif
@@ -113,10 +111,10 @@ TimerQueue::~TimerQueue() {
   }
 }
 
-TimerId TimerQueue::AddTimer(const TimerCallback& cb,
+TimerId TimerQueue::AddTimer(TimerCallback cb,
                              Timestamp when,
                              double interval) {
-  Timer* timer = new Timer(cb, when, interval);
+  Timer* timer = new Timer(std::move(cb), when, interval);
   loop_->RunInLoop(
       std::bind(&TimerQueue::AddTimerInLoop, this, timer));
   return TimerId(timer, timer->sequence());
@@ -142,7 +140,7 @@ void TimerQueue::AddTimerInLoop(Timer* timer) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
 int HowMuchTimeFromNow(Timestamp when) {
   int64_t microseconds = when.microseconds_since_epoch()
-                         - Timestamp::Now().microseconds_since_epoch();
+                         - Timestamp::MonotonicNow().microseconds_since_epoch();
   if (microseconds < 1000) {
     LogError("timerfd_settime()");
     microseconds = 1000;
@@ -179,10 +177,12 @@ void TimerQueue::CancelInLoop(TimerId timerId) {
 #if defined(__MACH__) || defined(__ANDROID_API__)
 void TimerQueue::ProcessTimers() {
 #else
-void TimerQueue::HandleRead() {
+void TimerQueue::HandleRead(Timestamp receive_time) {
 #endif
   loop_->AssertInLoopThread();
-  Timestamp now(Timestamp::Now());
+  // Taken after poll returned, so not before any expiration that made it
+  // return.
+  Timestamp now(loop_->cached_now());
 
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
   detail::ReadTimerfd(timerfd_, now);
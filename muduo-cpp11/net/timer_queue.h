@@ -20,6 +20,7 @@
 #include "muduo-cpp11/base/timestamp.h"
 #include "muduo-cpp11/net/callbacks.h"
 #include "muduo-cpp11/net/channel.h"
+#include "muduo-cpp11/net/channel_handler.h"
 
 namespace muduo_cpp11 {
 namespace net {
@@ -32,17 +33,17 @@ class TimerId;
 /// A best efforts timer queue.
 /// No guarantee that the callback will be on time.
 ///
-class TimerQueue {
+class TimerQueue : private ChannelHandler {
  public:
   TimerQueue(EventLoop* loop);
   ~TimerQueue();
 
   ///
-  /// Schedules the callback to be run at given time,
-  /// repeats if @c interval > 0.0.
+  /// Schedules the callback to be run at given time, a
+  /// Timestamp::MonotonicNow() time, repeats if @c interval > 0.0.
   ///
   /// Must be thread safe. Usually be called from other threads.
-  TimerId AddTimer(const TimerCallback& cb,
+  TimerId AddTimer(TimerCallback cb,
                    Timestamp when,
                    double interval);
 
@@ -65,8 +66,8 @@ class TimerQueue {
   void CancelInLoop(TimerId timerId);
 
 #if !defined(__MACH__) && !defined(__ANDROID_API__)
-  // called when timerfd alarms
-  void HandleRead();
+  // ChannelHandler, called when timerfd alarms
+  virtual void HandleRead(Timestamp receive_time);
 #endif
 
   // move out all expired timers
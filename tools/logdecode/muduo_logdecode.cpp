@@ -0,0 +1,265 @@
+// Turns a file written by BinaryLogging back into text, one line per
+// record in the glog layout:
+//
+//   I1018 17:05:28.123456 12345 tcp_server.cpp:156] message
+//
+// Usage: muduo_logdecode <binary_log_file>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+
+#include "muduo-cpp11/base/binary_logging.h"
+
+using std::string;
+
+namespace {
+
+struct Site {
+  string severity;
+  string file;
+  int line;
+  string format;
+};
+
+class Reader {
+ public:
+  Reader(const char* data, const char* end) : pos_(data), end_(end) {
+  }
+
+  bool ok() const {
+    return pos_ <= end_;
+  }
+
+  size_t remaining() const {
+    return pos_ < end_ ? end_ - pos_ : 0;
+  }
+
+  const char* pos() const {
+    return pos_;
+  }
+
+  template <typename T>
+  T Read() {
+    T value = T();
+    if (remaining() >= sizeof value) {
+      memcpy(&value, pos_, sizeof value);
+    }
+    pos_ += sizeof value;
+    return value;
+  }
+
+  void Skip(const size_t len) {
+    pos_ += len;
+  }
+
+  string ReadString(const size_t len) {
+    string value;
+    if (remaining() >= len) {
+      value.assign(pos_, len);
+    }
+    pos_ += len;
+    return value;
+  }
+
+ private:
+  const char* pos_;
+  const char* end_;
+};
+
+// Appends one argument formatted with the conversion spec taken from the
+// format string. Length modifiers are dropped, the recorded type decides.
+void AppendArg(string* out, const string& spec, const char conversion, Reader* args) {
+  char buf[256];
+  if (args->remaining() == 0) {
+    out->append("<missing>");
+    return;
+  }
+
+  uint8_t type = args->Read<uint8_t>();
+  switch (type) {
+    case muduo_cpp11::binlog::kIntArg: {
+      int64_t value = args->Read<int64_t>();
+      if (conversion == 'c') {
+        snprintf(buf, sizeof buf, (spec + "c").c_str(), static_cast<int>(value));
+      } else {
+        const char* conv = strchr("diouxX", conversion) != NULL ? &conversion : "d";
+        snprintf(buf, sizeof buf, (spec + "ll" + string(conv, 1)).c_str(),
+                 static_cast<long long>(value));
+      }
+      break;
+    }
+
+    case muduo_cpp11::binlog::kUintArg: {
+      uint64_t value = args->Read<uint64_t>();
+      const char* conv = strchr("diouxX", conversion) != NULL ? &conversion : "u";
+      snprintf(buf, sizeof buf, (spec + "ll" + string(conv, 1)).c_str(),
+               static_cast<unsigned long long>(value));
+      break;
+    }
+
+    case muduo_cpp11::binlog::kDoubleArg: {
+      double value = args->Read<double>();
+      const char* conv = strchr("fFeEgGaA", conversion) != NULL ? &conversion : "g";
+      snprintf(buf, sizeof buf, (spec + string(conv, 1)).c_str(), value);
+      break;
+    }
+
+    case muduo_cpp11::binlog::kStringArg: {
+      uint32_t len = args->Read<uint32_t>();
+      string value = args->ReadString(len);
+      if (spec == "%") {
+        out->append(value);
+        return;
+      }
+      snprintf(buf, sizeof buf, (spec + "s").c_str(), value.c_str());
+      break;
+    }
+
+    case muduo_cpp11::binlog::kPointerArg: {
+      uint64_t value = args->Read<uint64_t>();
+      snprintf(buf, sizeof buf, "%p", reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+      break;
+    }
+
+    default:
+      out->append("<bad argument>");
+      return;
+  }
+
+  out->append(buf);
+}
+
+string FormatMessage(const string& format, Reader* args) {
+  string out;
+  for (size_t i = 0; i < format.size(); ++i) {
+    if (format[i] != '%') {
+      out.push_back(format[i]);
+      continue;
+    }
+
+    if (i + 1 < format.size() && format[i + 1] == '%') {
+      out.push_back('%');
+      ++i;
+      continue;
+    }
+
+    string spec("%");
+    size_t j = i + 1;
+    while (j < format.size() && strchr("-+ #0123456789.", format[j]) != NULL) {
+      spec.push_back(format[j++]);
+    }
+    while (j < format.size() && strchr("hlLqjzt", format[j]) != NULL) {
+      ++j;
+    }
+    if (j == format.size()) {
+      out.append(format, i, string::npos);
+      break;
+    }
+
+    AppendArg(&out, spec, format[j], args);
+    i = j;
+  }
+  return out;
+}
+
+void PrintRecord(const Site& site, const int32_t tid, const int64_t microseconds, Reader* args) {
+  time_t seconds = static_cast<time_t>(microseconds / 1000000);
+  struct tm tm;
+  localtime_r(&seconds, &tm);
+
+  const char* file = strrchr(site.file.c_str(), '/');
+  file = file != NULL ? file + 1 : site.file.c_str();
+
+  printf("%c%02d%02d %02d:%02d:%02d.%06d %5d %s:%d] %s\n",
+         site.severity.empty() ? '?' : site.severity[0],
+         tm.tm_mon + 1,
+         tm.tm_mday,
+         tm.tm_hour,
+         tm.tm_min,
+         tm.tm_sec,
+         static_cast<int>(microseconds % 1000000),
+         tid,
+         file,
+         site.line,
+         FormatMessage(site.format, args).c_str());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <binary_log_file>\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Cannot open %s\n", argv[1]);
+    return 1;
+  }
+  string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  if (data.size() < sizeof muduo_cpp11::binlog::kFileMagic ||
+      memcmp(data.data(), muduo_cpp11::binlog::kFileMagic, sizeof muduo_cpp11::binlog::kFileMagic) != 0) {
+    fprintf(stderr, "%s is not a muduo binary log\n", argv[1]);
+    return 1;
+  }
+
+  std::map<uint32_t, Site> sites;
+  Reader reader(data.data() + sizeof muduo_cpp11::binlog::kFileMagic, data.data() + data.size());
+
+  while (reader.remaining() > 0) {
+    uint8_t kind = reader.Read<uint8_t>();
+    if (kind == muduo_cpp11::binlog::kSiteEntry) {
+      uint32_t id = reader.Read<uint32_t>();
+      Site& site = sites[id];
+      site.line = reader.Read<int32_t>();
+      site.severity = reader.ReadString(reader.Read<uint16_t>());
+      site.file = reader.ReadString(reader.Read<uint16_t>());
+      site.format = reader.ReadString(reader.Read<uint32_t>());
+    } else if (kind == muduo_cpp11::binlog::kRecordsEntry) {
+      int32_t tid = reader.Read<int32_t>();
+      uint32_t bytes = reader.Read<uint32_t>();
+      Reader records(reader.pos(), reader.pos() + std::min<size_t>(bytes, reader.remaining()));
+      reader.Skip(bytes);
+
+      while (records.remaining() >= muduo_cpp11::binlog::kRecordHeaderSize) {
+        const char* start = records.pos();
+        uint32_t size = records.Read<uint32_t>();
+        uint32_t site_id = records.Read<uint32_t>();
+        int64_t microseconds = records.Read<int64_t>();
+        if (size < muduo_cpp11::binlog::kRecordHeaderSize ||
+            size - muduo_cpp11::binlog::kRecordHeaderSize > records.remaining()) {
+          fprintf(stderr, "Truncated record\n");
+          break;
+        }
+
+        Reader args(records.pos(), start + size);
+        std::map<uint32_t, Site>::const_iterator it = sites.find(site_id);
+        if (it != sites.end()) {
+          PrintRecord(it->second, tid, microseconds, &args);
+        } else {
+          printf("<unknown site %u>\n", site_id);
+        }
+        records.Skip(size - muduo_cpp11::binlog::kRecordHeaderSize);
+      }
+    } else if (kind == muduo_cpp11::binlog::kDroppedEntry) {
+      int32_t tid = reader.Read<int32_t>();
+      uint64_t count = reader.Read<uint64_t>();
+      printf("W %5d] %" PRIu64 " log records dropped, ring full\n", tid, count);
+    } else {
+      fprintf(stderr, "Bad entry kind %d\n", kind);
+      return 1;
+    }
+  }
+
+  return reader.ok() ? 0 : 1;
+}